@@ -0,0 +1,248 @@
+#include "tracer_utils.h"
+
+#include "camera.h"
+#include "color.h"
+#include "cpu_dispatch.h"
+#include "engine.h"
+#include "imageio.h"
+#include "linear_bvh.h"
+#include "scene_manager.h"
+#include "tracer_constants.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Headless benchmark: every scene is rendered in every engine mode at a
+// reduced size, with fixed seeds, and the timings are written to a JSON
+// report so that versions can be compared.
+//
+// With a reference directory, every render is compared to the image of the
+// same scene and mode found there, or saved there when missing: running a
+// double precision build then a RAYTRACER_FLOAT_GEOMETRY one on the same
+// directory measures the error of single precision geometry. A reference
+// rendered with many samples measures the noise left by each sampler.
+//
+// Every scene also renders a progressive_budget run: the progressive mode
+// within half the time of its full render, which exercises the deadline.
+//
+// usage: raytracer_bench [report.json] [samples_per_pixel] [thread_count] [reference_dir] [sampler]
+
+namespace tc = tracer_constants;
+
+namespace {
+
+// 4:3 like the default output size
+constexpr int bench_width = 192;
+constexpr int bench_height = 144;
+
+constexpr std::uint64_t bench_seed = 0x853c49e6748fea9bULL;
+
+using bench_engine = engine<bench_width,bench_height,tc::color_channels,dynamic_gui_stub>;
+
+struct bench_result
+{
+    std::string scene;
+    std::string mode;
+    double scene_build_ms = 0.0;    // scene setup, BVH builds excluded
+    double bvh_build_ms = 0.0;
+    double render_ms = 0.0;
+    double time_budget_ms = 0.0;    // progressive deadline, 0 without budget
+    int rendered_samples = 0;       // samples per pixel actually rendered (mean for variance adaptive)
+    path_statistics stats;
+    std::uint64_t image_hash = 0;   // FNV-1a of the 8 bit output, to spot output changes
+    double reference_rmse = -1.0;   // 8 bit RMSE against the reference image, -1 without reference
+    int reference_max_error = -1;
+};
+
+constexpr std::array<const char*,9> scene_names{
+    "random", "two_spheres", "two_perlin_spheres", "earth", "simple_light",
+    "cornell_box", "cornell_smoke", "final", "mesh" };
+
+std::uint64_t fnv1a(const std::vector<std::uint8_t>& data)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto byte : data) {
+        hash ^= byte;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Compare the output to the reference image of path, or save it there when
+// there is none yet
+void compare_to_reference(const std::string& path, const std::vector<std::uint8_t>& image, bench_result& r)
+{
+    if (!std::filesystem::exists(path)) {
+        if (!imageio::save_image(path, bench_width, bench_height, tc::color_channels, image.data()))
+            throw std::runtime_error("cannot write " + path);
+        return;
+    }
+
+    int width = 0, height = 0, channels = 0;
+    const auto reference = imageio::load_image(path, width, height, channels);
+    if (!reference || width != bench_width || height != bench_height || channels != tc::color_channels)
+        throw std::runtime_error("reference image " + path + " does not match the benchmark output");
+
+    double squared_error = 0.0;
+    int max_error = 0;
+    for (size_t k = 0; k < image.size(); ++k) {
+        const int error = std::abs(static_cast<int>(image[k]) - static_cast<int>(reference[k]));
+        squared_error += static_cast<double>(error*error);
+        max_error = std::max(max_error, error);
+    }
+    r.reference_rmse = std::sqrt(squared_error / static_cast<double>(image.size()));
+    r.reference_max_error = max_error;
+}
+
+double per_second(double count, double ms)
+{
+    return ms > 0.0 ? 1000.0 * count / ms : 0.0;
+}
+
+void write_report(std::ostream& os, const std::vector<bench_result>& results, int samples_per_pixel, size_t thread_count,
+                  sampler_kind sampling)
+{
+    os << "{\n"
+       << "  \"width\": " << bench_width << ",\n"
+       << "  \"height\": " << bench_height << ",\n"
+       << "  \"samples_per_pixel\": " << samples_per_pixel << ",\n"
+       << "  \"threads\": " << thread_count << ",\n"
+       << "  \"geometry\": \"" << (std::is_same_v<real,float> ? "float" : "double") << "\",\n"
+       << "  \"isa\": \"" << cpu_dispatch::kernels().name << "\",\n"
+       << "  \"sampler\": \"" << sampler::name(sampling) << "\",\n"
+       << "  \"traversal_statistics\": " << (tc::traversal_statistics ? "true" : "false") << ",\n"
+       << "  \"runs\": [\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const auto& r = results[k];
+        os << "    { \"scene\": \"" << r.scene << "\", \"mode\": \"" << r.mode << "\""
+           << ", \"scene_build_ms\": " << r.scene_build_ms
+           << ", \"bvh_build_ms\": " << r.bvh_build_ms
+           << ", \"render_ms\": " << r.render_ms
+           << ", \"time_budget_ms\": " << r.time_budget_ms
+           << ", \"rendered_spp\": " << r.rendered_samples
+           << ", \"rays\": " << r.stats.rays()
+           << ", \"samples\": " << r.stats.paths
+           << ", \"secondary_rays\": " << r.stats.bounces
+           << ", \"escaped\": " << r.stats.escaped
+           << ", \"absorbed\": " << r.stats.absorbed
+           << ", \"roulette\": " << r.stats.roulette
+           << ", \"depth_limit\": " << r.stats.depth_limit
+           << ", \"bvh_queries\": " << r.stats.bvh_queries
+           << ", \"nodes_visited\": " << r.stats.nodes_visited
+           << ", \"hittable_tests\": " << r.stats.hittable_tests
+           << ", \"hittable_hits\": " << r.stats.hittable_hits
+           << ", \"rays_per_s\": " << per_second(static_cast<double>(r.stats.rays()), r.render_ms)
+           << ", \"samples_per_s\": " << per_second(static_cast<double>(r.stats.paths), r.render_ms)
+           << ", \"image_hash\": \"" << std::hex << std::setw(16) << std::setfill('0') << r.image_hash
+           << std::dec << std::setfill(' ') << "\""
+           << ", \"reference_rmse\": " << r.reference_rmse
+           << ", \"reference_max_error\": " << r.reference_max_error << " }"
+           << (k+1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) try
+{
+    const std::string report_path = argc >= 2 ? argv[1] : "bench_report.json";
+    const int samples_per_pixel = argc >= 3 ? std::max(4,std::atoi(argv[2])) : 16;
+    size_t thread_count = argc >= 4 ? static_cast<size_t>(std::max(0,std::atoi(argv[3]))) : tc::thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const std::string reference_dir = argc >= 5 ? argv[4] : "";
+    if (!reference_dir.empty())
+        std::filesystem::create_directories(reference_dir);
+    sampler_kind sampling = sampler_kind::sobol;
+    if (argc >= 6 && !sampler::parse(argv[5], sampling))
+        throw std::runtime_error(std::string("unknown sampler ") + argv[5] + ", expected independent, stratified, sobol or blue_noise");
+
+    std::vector<bench_result> results;
+    std::vector<std::uint8_t> output_image(bench_engine::frame_size);
+
+    for (size_t s = 0; s < scene_names.size(); ++s) {
+        // scene generation draws random numbers too: seed it per scene so
+        // that every scene is the same whatever runs before it
+        thread_rng().seed(bench_seed, s);
+
+        const auto bvh_before = linear_bvh::build_time_ms();
+        const auto build_start = std::chrono::steady_clock::now();
+        scene_manager scene_mgr;
+        scene world = scene_mgr.build(static_cast<scene_alias>(s+1));
+        const auto build_end = std::chrono::steady_clock::now();
+        const auto bvh_ms = linear_bvh::build_time_ms() - bvh_before;
+        const auto build_ms = std::chrono::duration<double,std::milli>(build_end - build_start).count() - bvh_ms;
+
+        camera cam(world.lookfrom, world.lookat, vec3(0,1,0), world.vfov, tc::aspect_ratio, world.aperture, 10.0, 0.0, 1.0);
+
+        const auto render = [&](engine_mode mode, std::string mode_name, std::chrono::milliseconds time_budget) {
+            bench_engine eng(cam, mode, thread_count);
+            eng.set_scene(world.objects, world.background);
+            eng.set_samples_per_pixel(samples_per_pixel);
+            eng.set_sampler(sampling);
+            eng.set_time_budget(time_budget);
+            eng.set_frame(0);
+
+            const auto render_start = std::chrono::steady_clock::now();
+            eng.run(output_image.data());
+            const auto render_end = std::chrono::steady_clock::now();
+
+            bench_result r;
+            r.scene = scene_names[s];
+            r.mode = std::move(mode_name);
+            r.scene_build_ms = build_ms;
+            r.bvh_build_ms = bvh_ms;
+            r.render_ms = std::chrono::duration<double,std::milli>(render_end - render_start).count();
+            r.time_budget_ms = static_cast<double>(time_budget.count());
+            r.rendered_samples = eng.rendered_samples_per_pixel();
+            r.stats = eng.stats();
+            r.image_hash = fnv1a(output_image);
+            if (!reference_dir.empty())
+                compare_to_reference(reference_dir + "/" + r.scene + "_" + r.mode + ".png", output_image, r);
+            results.push_back(r);
+
+            std::cout << std::endl << "[bench] " << r.scene << " / " << r.mode << ": " << r.render_ms << " ms, "
+                      << per_second(static_cast<double>(r.stats.rays()), r.render_ms) << " rays/s";
+            if (r.reference_rmse >= 0.0)
+                std::cout << ", rmse " << r.reference_rmse << " (max " << r.reference_max_error << ") against the reference";
+            std::cout << std::endl;
+            return r.render_ms;
+        };
+
+        double progressive_ms = 0.0;
+        for (const auto mode : engine_modes) {
+            const auto ms = render(mode, engine_mode_name(mode), std::chrono::milliseconds{0});
+            if (mode == engine_mode::progressive)
+                progressive_ms = ms;
+        }
+
+        // the progressive mode again, with half the time of the full render:
+        // the deadline stops it early, whatever the speed of the host. Its
+        // image and hash depend on the timing, unlike the other runs.
+        const auto budget = std::chrono::milliseconds{std::max<long long>(1, static_cast<long long>(progressive_ms / 2))};
+        render(engine_mode::progressive, "progressive_budget", budget);
+    }
+
+    std::ofstream report(report_path);
+    if (!report)
+        throw std::runtime_error("cannot write " + report_path);
+    write_report(report, results, samples_per_pixel, thread_count, sampling);
+    std::cout << std::endl << "benchmark report written to " << report_path << std::endl;
+
+    return EXIT_SUCCESS;
+}
+catch(const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
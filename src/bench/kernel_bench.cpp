@@ -0,0 +1,269 @@
+#include "tracer_utils.h"
+
+#include "aabb.h"
+#include "aarect.h"
+#include "bvh.h"
+#include "camera.h"
+#include "cpu_dispatch.h"
+#include "material.h"
+#include "moving_sphere.h"
+#include "scene_manager.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "tracer_constants.h"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Intersection kernel microbenchmarks: single primitives and BVHs built from
+// the scenes are traced against reproducible ray sets, coherent (primary,
+// one ray per pixel of a small camera) and incoherent (diffuse bounces),
+// and the cost per ray of every kernel is reported. Coherent rays are also
+// traced as 2x2 packets.
+//
+// usage: raytracer_kernel_bench [min_time_ms]
+
+namespace tc = tracer_constants;
+
+namespace {
+
+constexpr int grid_width = 256;
+constexpr int grid_height = 192;
+constexpr size_t incoherent_ray_count = static_cast<size_t>(grid_width*grid_height);
+constexpr int min_passes = 3;
+
+constexpr std::uint64_t bench_seed = 0xda3e39cb94b95bdbULL;
+
+using ray_set = std::vector<ray>;
+using kernel = std::function<bool(const ray&)>;
+
+// 2x2 pixel packets, traced with hit_packet
+using packet_set = std::vector<std::array<ray,ray_packet::size>>;
+using packet_kernel = std::function<int(const std::array<ray,ray_packet::size>&)>;
+
+// Primary rays of a pinhole camera, in scanline order
+ray_set coherent_rays(const camera& cam)
+{
+    ray_set rays;
+    rays.reserve(static_cast<size_t>(grid_width*grid_height));
+    for (int j = grid_height-1; j >= 0; --j)
+        for (int i = 0; i < grid_width; ++i)
+            rays.push_back(cam.get_ray(static_cast<real>((i + 0.5) / grid_width), static_cast<real>((j + 0.5) / grid_height)));
+    return rays;
+}
+
+// Primary rays grouped in packets of 2x2 pixels
+packet_set coherent_packets(const ray_set& primary)
+{
+    packet_set packets;
+    packets.reserve(primary.size()/ray_packet::size);
+    for (size_t row = 0; row < static_cast<size_t>(grid_height); row += 2)
+        for (size_t i = 0; i < static_cast<size_t>(grid_width); i += 2) {
+            const auto first = row*grid_width + i;
+            packets.push_back({ primary[first], primary[first+1], primary[first+grid_width], primary[first+grid_width+1] });
+        }
+    return packets;
+}
+
+// Rays leaving random points of a box in random directions
+ray_set incoherent_rays(const aabb& box)
+{
+    ray_set rays;
+    rays.reserve(incoherent_ray_count);
+    for (size_t k = 0; k < incoherent_ray_count; ++k) {
+        const point3 origin(
+            random_real(box.min().x(), box.max().x()),
+            random_real(box.min().y(), box.max().y()),
+            random_real(box.min().z(), box.max().z()));
+        rays.emplace_back(origin, random_unit_vector(), random_real());
+    }
+    return rays;
+}
+
+// Diffuse bounces of primary rays: hit points scatter around their normal,
+// missed rays are sent in a random direction from the camera
+ray_set diffuse_rays(const hittable& world, const ray_set& primary)
+{
+    ray_set rays;
+    rays.reserve(primary.size());
+    for (const auto& r : primary) {
+        hit_record rec;
+        if (world.hit(r, real(0.001), infinity, rec))
+            rays.emplace_back(rec.p, rec.normal + random_unit_vector(), r.time());
+        else
+            rays.emplace_back(r.origin(), random_unit_vector(), r.time());
+    }
+    return rays;
+}
+
+// Camera framing the bounding sphere of a box from a slightly oblique point of view
+camera framing_camera(const aabb& box, double time0, double time1)
+{
+    const auto center = box.centroid();
+    const auto radius = 0.5*(box.max() - box.min()).length();
+    const auto distance = 4.0*radius;
+    const auto lookfrom = center + distance*unit_vector(vec3(0.3, 0.2, 1.0));
+    const auto vfov = 2.0*std::atan(0.7*radius/distance)*180.0/pi;
+    return camera(lookfrom, center, vec3(0,1,0), vfov, static_cast<double>(grid_width)/grid_height, 0.0, distance, time0, time1);
+}
+
+struct kernel_result
+{
+    std::string name;
+    std::string ray_set_name;
+    size_t rays = 0;
+    double hit_ratio = 0.0;
+    double ns_per_ray = 0.0;
+};
+
+// Items are rays or packets, k returns the number of rays of an item that hit
+template<typename item_set, typename item_kernel>
+kernel_result measure(const std::string& name, const std::string& ray_set_name, const item_set& items,
+                      const item_kernel& k, double min_time_ms)
+{
+    constexpr size_t rays_per_item = std::is_same_v<item_set,packet_set> ? ray_packet::size : 1;
+
+    size_t traced = 0;
+    size_t hits = 0;
+    int passes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration{};
+    do {
+        for (const auto& item : items)
+            hits += static_cast<size_t>(k(item));
+        traced += items.size()*rays_per_item;
+        ++passes;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (passes < min_passes || std::chrono::duration<double,std::milli>(elapsed).count() < min_time_ms);
+
+    kernel_result result;
+    result.name = name;
+    result.ray_set_name = ray_set_name;
+    result.rays = items.size()*rays_per_item;
+    result.hit_ratio = static_cast<double>(hits) / static_cast<double>(traced);
+    result.ns_per_ray = std::chrono::duration<double,std::nano>(elapsed).count() / static_cast<double>(traced);
+    return result;
+}
+
+void print_result(const kernel_result& r)
+{
+    std::cout << std::left << std::setw(36) << r.name << std::setw(12) << r.ray_set_name << std::right
+              << std::setw(9) << r.rays
+              << std::setw(9) << std::fixed << std::setprecision(1) << 100.0*r.hit_ratio << "%"
+              << std::setw(12) << std::setprecision(2) << r.ns_per_ray
+              << std::setw(12) << std::setprecision(3) << 1000.0/r.ns_per_ray
+              << std::defaultfloat << std::endl;
+}
+
+// Measure a hittable against its coherent and incoherent ray sets
+void bench_hittable(const std::string& name, std::uint64_t stream, const hittable& object, real time0, real time1, double min_time_ms)
+{
+    aabb box;
+    object.bounding_box(time0, time1, box);
+
+    thread_rng().seed(bench_seed, stream);
+    const auto coherent = coherent_rays(framing_camera(box, time0, time1));
+    const auto incoherent = incoherent_rays(aabb(box.centroid() - (box.max() - box.min()), box.centroid() + (box.max() - box.min())));
+
+    const kernel k = [&object](const ray& r) {
+        hit_record rec;
+        return object.hit(r, real(0.001), infinity, rec);
+    };
+    print_result(measure(name, "coherent", coherent, k, min_time_ms));
+    print_result(measure(name, "incoherent", incoherent, k, min_time_ms));
+}
+
+} // namespace
+
+int main(int argc, char **argv) try
+{
+    const double min_time_ms = argc >= 2 ? std::max(1.0, std::atof(argv[1])) : 200.0;
+
+    std::vector<std::pair<std::string,scene>> scenes;
+    const std::array<const char*,9> scene_names{
+        "random", "two_spheres", "two_perlin_spheres", "earth", "simple_light",
+        "cornell_box", "cornell_smoke", "final", "mesh" };
+
+    // scenes are built first so that their loading logs stay out of the table
+    std::vector<std::shared_ptr<bvh_node>> scene_bvhs;
+    for (size_t s = 0; s < scene_names.size(); ++s) {
+        thread_rng().seed(bench_seed, s);
+        scene_manager scene_mgr;
+        scenes.emplace_back(scene_names[s], scene_mgr.build(static_cast<scene_alias>(s+1)));
+        scene_bvhs.push_back(std::make_shared<bvh_node>(scenes.back().second.objects, 0.0, 1.0));
+    }
+
+    std::cout << std::endl << "kernels: " << cpu_dispatch::kernels().name << std::endl;
+    std::cout << std::endl << std::left << std::setw(36) << "kernel" << std::setw(12) << "rays" << std::right
+              << std::setw(9) << "count" << std::setw(10) << "hits" << std::setw(12) << "ns/ray" << std::setw(12) << "Mrays/s"
+              << std::endl;
+
+    // single primitives
+    auto mat = std::make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    bench_hittable("sphere::hit", 1, sphere(point3(0,0,0), 1.0, mat), 0.0, 1.0, min_time_ms);
+    bench_hittable("moving_sphere::hit", 2, moving_sphere(point3(0,0,0), point3(0,0.5,0), 0.0, 1.0, 1.0, mat), 0.0, 1.0, min_time_ms);
+    bench_hittable("triangle::hit", 3, triangle(point3(-1,-1,0), point3(1,-1,0), point3(0,1,0.2), mat), 0.0, 1.0, min_time_ms);
+    bench_hittable("xy_rect::hit", 4, xy_rect(-1, 1, -1, 1, 0, mat), 0.0, 1.0, min_time_ms);
+
+    {
+        const aabb box(point3(-1,-1,-1), point3(1,1,1));
+        thread_rng().seed(bench_seed, 5);
+        const auto coherent = coherent_rays(framing_camera(box, 0.0, 1.0));
+        const auto incoherent = incoherent_rays(aabb(point3(-2,-2,-2), point3(2,2,2)));
+        const kernel k = [&box](const ray& r) { return box.hit(r, real(0.001), infinity); };
+        print_result(measure("aabb::hit", "coherent", coherent, k, min_time_ms));
+        print_result(measure("aabb::hit", "incoherent", incoherent, k, min_time_ms));
+    }
+
+    // hierarchies over the scenes, traced with the scene cameras
+    for (size_t s = 0; s < scenes.size(); ++s) {
+        const auto& [name, world] = scenes[s];
+        const auto& tree = *scene_bvhs[s];
+
+        thread_rng().seed(bench_seed, 100 + s);
+        const camera cam(world.lookfrom, world.lookat, vec3(0,1,0), world.vfov, tc::aspect_ratio, world.aperture, 10.0, 0.0, 1.0);
+        const auto primary = coherent_rays(cam);
+        const auto diffuse = diffuse_rays(tree, primary);
+
+        const kernel k = [&tree](const ray& r) {
+            hit_record rec;
+            return tree.hit(r, real(0.001), infinity, rec);
+        };
+        print_result(measure("bvh_node::hit (" + name + ")", "coherent", primary, k, min_time_ms));
+        print_result(measure("bvh_node::hit (" + name + ")", "incoherent", diffuse, k, min_time_ms));
+
+        // packets against the hierarchy and against the scene list traced by the engine
+        const auto packets = coherent_packets(primary);
+        const auto packet_hits = [](const hittable& object) {
+            return packet_kernel([&object](const std::array<ray,ray_packet::size>& rays) {
+                const ray_packet packet(rays, ray_packet::all_lanes);
+                packet_distances t_max;
+                t_max.fill(infinity);
+                packet_records rec;
+                return std::popcount(static_cast<unsigned>(object.hit_packet(packet, ray_packet::all_lanes, real(0.001), t_max, rec)));
+            });
+        };
+        const kernel world_k = [&world](const ray& r) {
+            hit_record rec;
+            return world.objects.hit(r, real(0.001), infinity, rec);
+        };
+        print_result(measure("bvh_node::hit_packet (" + name + ")", "packets", packets, packet_hits(tree), min_time_ms));
+        print_result(measure("world::hit (" + name + ")", "coherent", primary, world_k, min_time_ms));
+        print_result(measure("world::hit_packet (" + name + ")", "packets", packets, packet_hits(world.objects), min_time_ms));
+    }
+
+    return EXIT_SUCCESS;
+}
+catch(const std::exception& e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
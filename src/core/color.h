@@ -1,24 +1,15 @@
 #ifndef COLOR_H
 #define COLOR_H
 
+#include "cpu_dispatch.h"
 #include "vec3.h"
 
-template<typename T = std::uint8_t>
-inline void write_color(T* out, color pixel_color, int samples_per_pixel) {
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
+#include <cstdint>
 
-    // Divide the color by the number of samples and gamma-correct for gamma=2.0.
-    auto scale = 1.0 / samples_per_pixel;
-    r = std::sqrt(scale * r);
-    g = std::sqrt(scale * g);
-    b = std::sqrt(scale * b);
-    
-    // Write the translated [0,255] value of each color component.
-    out[0] = static_cast<T>(256 * clamp(r, 0.0, 0.999));
-    out[1] = static_cast<T>(256 * clamp(g, 0.0, 0.999));
-    out[2] = static_cast<T>(256 * clamp(b, 0.0, 0.999));
+// Divide the color by the number of samples, gamma-correct for gamma=2.0 and
+// write the translated [0,255] value of each color component.
+inline void write_color(std::uint8_t* out, color pixel_color, int samples_per_pixel) {
+    cpu_dispatch::kernels().color_bytes(out, pixel_color.e, samples_per_pixel);
 }
 
 template<typename T = std::uint8_t>
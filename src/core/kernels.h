@@ -0,0 +1,80 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "real.h"
+
+#include <cstdint>
+
+// Hot intersection and conversion kernels, compiled once per instruction set
+// (kernels_<isa>.cpp, all built from kernels_impl.h) and called through the
+// table that cpu_dispatch selects for the host. Their arguments are plain
+// scalars and arrays: the variants cannot share the inline vector code.
+
+// Relative bound of the rounding errors of the single precision slab test:
+// far distances are pushed away by this amount so that boxes are never missed.
+constexpr float box4_far_scale = 1.0f + 4.0f*0x1p-23f;
+
+// Per ray data of the 4-wide slab test. Every axis holds the near then the
+// far half of an 8 lane register: origins nudged by one ulp towards the near
+// and the far planes, and the inverse direction, negated on the far half so
+// that both halves shrink the interval with a max.
+struct alignas(32) box4_ray {
+    float origin[3][8];
+    float inv_dir[3][8];
+    int dir_is_neg[3];
+};
+
+// Per ray data of the batched triangle test
+struct triangle4_ray {
+    float origin[3];
+    float direction[3];
+    float origin_norm;      // |origin|, L1
+    float direction_norm;   // |direction|, L1
+};
+
+// Single precision triangle arrays of a mesh, one per component, padded so
+// that four lanes can be read from any triangle, with the L1 norms bounding
+// the rounding errors of the batched test
+struct triangle4_arrays {
+    const float* v0[3];
+    const float* e1[3];             // v1 - v0
+    const float* e2[3];             // v2 - v0
+    const float* v0_norm;           // |v0|
+    const float* edge_sum;          // |e1| + |e2|
+    const float* edge_product;      // |e1| * |e2|
+};
+
+struct kernel_table {
+    const char* name;
+
+    // Nearest root within [t_min,t_max] of a ray with a sphere, oc being the
+    // ray origin minus the center
+    bool (*sphere_root)(const real* oc, const real* direction, real radius,
+                        real t_min, real t_max, real& root);
+
+    // Möller-Trumbore test of a ray with the triangle (v0, v0+e1, v0+e2), b1
+    // and b2 being the barycentric weights of the second and third vertices
+    bool (*triangle)(const real* origin, const real* direction, const real* v0, const real* e1, const real* e2,
+                     real t_min, real t_max, real& t, real& b1, real& b2);
+
+    // Conservative test of the count (up to four) triangles from first:
+    // returns the mask of the ones that may be hit before t_max, which are
+    // then confirmed by the triangle kernel
+    int (*triangle4)(const triangle4_arrays& triangles, std::uint32_t first, std::uint32_t count,
+                     const triangle4_ray& ray, float t_max);
+
+    // Slab test of the four children of a wide BVH node, bounds being stored
+    // axis by axis and t_max scaled by box4_far_scale: returns the mask of
+    // the children hit and writes their entry distances to t_near
+    int (*box4)(const float* bounds_min, const float* bounds_max, const box4_ray& ray,
+                float t_min, float t_max, float* t_near);
+
+    // Gamma corrected [0,255] bytes of a color summed over samples
+    void (*color_bytes)(std::uint8_t* out, const real* rgb, int samples);
+};
+
+extern const kernel_table baseline_kernels;
+extern const kernel_table avx2_kernels;
+extern const kernel_table avx512_kernels;
+
+#endif
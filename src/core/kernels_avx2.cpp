@@ -0,0 +1,4 @@
+// Kernels built for AVX2, see CMakeLists.txt for the flags
+#define KERNEL_TABLE avx2_kernels
+#define KERNEL_NAME "avx2"
+#include "kernels_impl.h"
@@ -0,0 +1,4 @@
+// Kernels built for AVX-512 (F, VL, DQ and BW), see CMakeLists.txt for the flags
+#define KERNEL_TABLE avx512_kernels
+#define KERNEL_NAME "avx512"
+#include "kernels_impl.h"
@@ -0,0 +1,4 @@
+// Kernels built with the compiler defaults, available on every host
+#define KERNEL_TABLE baseline_kernels
+#define KERNEL_NAME "baseline"
+#include "kernels_impl.h"
@@ -0,0 +1,387 @@
+// Bodies of the kernels declared in kernels.h, included once by every
+// kernels_<isa>.cpp with KERNEL_TABLE and KERNEL_NAME naming the table it
+// defines. The files are compiled with different instruction sets:
+//  - everything here has internal linkage and only calls intrinsics. An
+//    inline function shared with the rest of the program (vec3, float4,
+//    std::min...) could be emitted here with instructions the host lacks,
+//    and be the copy the linker keeps for the whole program;
+//  - nothing may run at static initialization time, hence no iostream;
+//  - contraction into FMA is disabled (see CMakeLists.txt), so that every
+//    variant returns the same results as the others, bit for bit.
+
+#include "kernels.h"
+#include "simd.h" // TRACER_SSE and the intrinsics only, float4 is not used here
+
+#if defined(TRACER_SSE) && defined(__AVX2__)
+    #define KERNEL_AVX2 1
+#endif
+#if defined(KERNEL_AVX2) && defined(__AVX512F__) && defined(__AVX512DQ__)
+    #define KERNEL_AVX512 1
+#endif
+
+namespace {
+
+// Bound of the relative rounding error of the single precision triangle
+// test, inputs rounding included, with a comfortable safety factor.
+constexpr float lane_error = 64.0f*0x1p-24f;
+
+// Lane arithmetic, the same templates serving scalars and registers
+
+inline float add(float a, float b) { return a + b; }
+inline float sub(float a, float b) { return a - b; }
+inline float mul(float a, float b) { return a * b; }
+inline double add(double a, double b) { return a + b; }
+inline double sub(double a, double b) { return a - b; }
+inline double mul(double a, double b) { return a * b; }
+
+// Registers are wrapped, their alignment attributes being lost as template arguments
+#ifdef TRACER_SSE
+struct lanes4 { __m128 v; };
+inline lanes4 add(lanes4 a, lanes4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline lanes4 sub(lanes4 a, lanes4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline lanes4 mul(lanes4 a, lanes4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+inline float square_root(float x) { return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x))); }
+inline double square_root(double x) {
+    const __m128d v = _mm_set_sd(x);
+    return _mm_cvtsd_f64(_mm_sqrt_sd(v, v));
+}
+inline float copy_sign(float magnitude, float sign) {
+    const __m128 sign_bit = _mm_set_ss(-0.0f);
+    return _mm_cvtss_f32(_mm_or_ps(_mm_andnot_ps(sign_bit, _mm_set_ss(magnitude)), _mm_and_ps(sign_bit, _mm_set_ss(sign))));
+}
+inline double copy_sign(double magnitude, double sign) {
+    const __m128d sign_bit = _mm_set_sd(-0.0);
+    return _mm_cvtsd_f64(_mm_or_pd(_mm_andnot_pd(sign_bit, _mm_set_sd(magnitude)), _mm_and_pd(sign_bit, _mm_set_sd(sign))));
+}
+#else
+// single variant, nothing to hide from the rest of the program
+inline float square_root(float x) { return std::sqrt(x); }
+inline double square_root(double x) { return std::sqrt(x); }
+inline float copy_sign(float magnitude, float sign) { return std::copysign(magnitude, sign); }
+inline double copy_sign(double magnitude, double sign) { return std::copysign(magnitude, sign); }
+#endif
+
+#ifdef KERNEL_AVX2
+struct lanes8 { __m256 v; };
+inline lanes8 add(lanes8 a, lanes8 b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline lanes8 sub(lanes8 a, lanes8 b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline lanes8 mul(lanes8 a, lanes8 b) { return {_mm256_mul_ps(a.v, b.v)}; }
+
+// [lo | hi]
+inline __m256 join(__m128 lo, __m128 hi) { return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1); }
+inline lanes8 join(lanes4 lo, lanes4 hi) { return {join(lo.v, hi.v)}; }
+#endif
+
+#ifdef KERNEL_AVX512
+struct lanes16 { __m512 v; };
+inline lanes16 add(lanes16 a, lanes16 b) { return {_mm512_add_ps(a.v, b.v)}; }
+inline lanes16 sub(lanes16 a, lanes16 b) { return {_mm512_sub_ps(a.v, b.v)}; }
+inline lanes16 mul(lanes16 a, lanes16 b) { return {_mm512_mul_ps(a.v, b.v)}; }
+
+inline lanes16 join(lanes8 lo, lanes8 hi) { return {_mm512_insertf32x8(_mm512_castps256_ps512(lo.v), hi.v, 1)}; }
+#endif
+
+template<typename L>
+struct xyz {
+    L x, y, z;
+};
+
+template<typename L>
+inline xyz<L> sub(const xyz<L>& a, const xyz<L>& b) { return {sub(a.x, b.x), sub(a.y, b.y), sub(a.z, b.z)}; }
+
+template<typename L>
+inline xyz<L> scale(L s, const xyz<L>& a) { return {mul(s, a.x), mul(s, a.y), mul(s, a.z)}; }
+
+template<typename L>
+inline L dot(const xyz<L>& a, const xyz<L>& b) { return add(add(mul(a.x, b.x), mul(a.y, b.y)), mul(a.z, b.z)); }
+
+template<typename L>
+inline xyz<L> cross(const xyz<L>& a, const xyz<L>& b) {
+    return {sub(mul(a.y, b.z), mul(a.z, b.y)),
+            sub(mul(a.z, b.x), mul(a.x, b.z)),
+            sub(mul(a.x, b.y), mul(a.y, b.x))};
+}
+
+inline xyz<real> load3(const real* p) { return {p[0], p[1], p[2]}; }
+
+bool sphere_root(const real* oc_data, const real* direction_data, real radius,
+                 real t_min, real t_max, real& root) {
+    const auto oc = load3(oc_data);
+    const auto direction = load3(direction_data);
+    const real a = dot(direction, direction);
+    const real half_b = dot(oc, direction);
+    const real c = dot(oc, oc) - radius*radius;
+
+    // The discriminant half_b*half_b - a*c cancels catastrophically for far
+    // origins, in single precision builds by far more than the hit epsilon:
+    // it is computed from the distance of the center to the line instead,
+    // and the roots are taken without the cancellation of -half_b + sqrtd
+    // (Haines et al., Precision Improvements for Ray/Sphere Intersection).
+    const auto l = sub(oc, scale(half_b/a, direction));
+    const real discriminant = a*(radius*radius - dot(l, l));
+    if (discriminant < 0)
+        return false;
+    const real sqrtd = square_root(discriminant);
+
+    const real q = -(half_b + copy_sign(sqrtd, half_b));
+    if (q == 0)
+        return false;
+    const real root0 = c / q;
+    const real root1 = q / a;
+
+    // Find the nearest root that lies in the acceptable range.
+    root = root1 < root0 ? root1 : root0;
+    if (root < t_min || t_max < root) {
+        root = root0 < root1 ? root1 : root0;
+        if (root < t_min || t_max < root)
+            return false;
+    }
+    return true;
+}
+
+bool triangle(const real* origin_data, const real* direction_data, const real* v0_data,
+              const real* e1_data, const real* e2_data, real t_min, real t_max, real& t, real& b1, real& b2) {
+    // Möller-Trumbore, REFERENCE: "Fast, Minimum Storage Ray/Triangle Intersection"
+    const auto direction = load3(direction_data);
+    const auto e1 = load3(e1_data);
+    const auto e2 = load3(e2_data);
+
+    const auto pvec = cross(direction, e2);
+    const real det = dot(e1, pvec);
+    if (det == 0)
+        return false; // ray parallel to the triangle plane
+    const real inv_det = 1 / det;
+
+    const auto tvec = sub(load3(origin_data), load3(v0_data));
+    b1 = dot(tvec, pvec) * inv_det;
+    if (b1 < 0 || b1 > 1)
+        return false;
+
+    const auto qvec = cross(tvec, e1);
+    b2 = dot(direction, qvec) * inv_det;
+    if (b2 < 0 || b1 + b2 > 1)
+        return false;
+
+    t = dot(e2, qvec) * inv_det;
+    return t >= t_min && t <= t_max;
+}
+
+#ifdef TRACER_SSE
+
+// Same steps as the triangle kernel on four triangles, without divisions: the
+// barycentric and distance tests are scaled by det, whose sign is moved to
+// the numerators, and widened by a priori bounds of the rounding errors.
+int triangle4(const triangle4_arrays& tri, std::uint32_t first, std::uint32_t count,
+              const triangle4_ray& ray, float t_max) {
+    const auto load = [first](const float* values) { return lanes4{_mm_loadu_ps(values + first)}; };
+    const auto broadcast = [](const float* values) {
+        return xyz<lanes4>{{_mm_set1_ps(values[0])}, {_mm_set1_ps(values[1])}, {_mm_set1_ps(values[2])}};
+    };
+
+    const xyz<lanes4> v0{load(tri.v0[0]), load(tri.v0[1]), load(tri.v0[2])};
+    const xyz<lanes4> e1{load(tri.e1[0]), load(tri.e1[1]), load(tri.e1[2])};
+    const xyz<lanes4> e2{load(tri.e2[0]), load(tri.e2[1]), load(tri.e2[2])};
+    const auto direction = broadcast(ray.direction);
+    const auto tvec = sub(broadcast(ray.origin), v0);
+
+    lanes4 det, u, v, t;
+#if defined(KERNEL_AVX512)
+    // both cross products in one 8 lane pass, the four dot products in one 16 lane pass
+    const auto join3 = [](const xyz<lanes4>& lo, const xyz<lanes4>& hi) {
+        return xyz<lanes8>{join(lo.x, hi.x), join(lo.y, hi.y), join(lo.z, hi.z)};
+    };
+    const auto join6 = [](const xyz<lanes8>& lo, const xyz<lanes8>& hi) {
+        return xyz<lanes16>{join(lo.x, hi.x), join(lo.y, hi.y), join(lo.z, hi.z)};
+    };
+    const auto pq = cross(join3(direction, tvec), join3(e2, e1));
+    const auto dvut = dot(join6(join3(e1, direction), join3(tvec, e2)), join6(pq, pq)).v;
+    // masked extractions: the plain ones and the cast read an undefined register
+    // (-Wuninitialized with GCC 12)
+    det.v = _mm512_maskz_extractf32x4_ps(0xf, dvut, 0);
+    v.v = _mm512_maskz_extractf32x4_ps(0xf, dvut, 1);
+    u.v = _mm512_maskz_extractf32x4_ps(0xf, dvut, 2);
+    t.v = _mm512_maskz_extractf32x4_ps(0xf, dvut, 3);
+#elif defined(KERNEL_AVX2)
+    // [pvec | qvec], then [det | v] and [u | t] in 8 lane passes
+    const auto join3 = [](const xyz<lanes4>& lo, const xyz<lanes4>& hi) {
+        return xyz<lanes8>{join(lo.x, hi.x), join(lo.y, hi.y), join(lo.z, hi.z)};
+    };
+    const auto pq = cross(join3(direction, tvec), join3(e2, e1));
+    const auto dv = dot(join3(e1, direction), pq).v;
+    const auto ut = dot(join3(tvec, e2), pq).v;
+    det.v = _mm256_castps256_ps128(dv);
+    v.v = _mm256_extractf128_ps(dv, 1);
+    u.v = _mm256_castps256_ps128(ut);
+    t.v = _mm256_extractf128_ps(ut, 1);
+#else
+    const auto pvec = cross(direction, e2);
+    const auto qvec = cross(tvec, e1);
+    det = dot(e1, pvec);
+    u = dot(tvec, pvec);
+    v = dot(direction, qvec);
+    t = dot(e2, qvec);
+#endif
+
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    const __m128 det_sign = _mm_and_ps(det.v, sign_bit);
+    u.v = _mm_xor_ps(u.v, det_sign);
+    v.v = _mm_xor_ps(v.v, det_sign);
+    t.v = _mm_xor_ps(t.v, det_sign);
+    const lanes4 abs_det{_mm_andnot_ps(sign_bit, det.v)};
+
+    // a priori error bounds of det, u, v and t
+    const auto edge_product = load(tri.edge_product);
+    const auto position_norm = add(lanes4{_mm_set1_ps(ray.origin_norm)}, load(tri.v0_norm));
+    const lanes4 error{_mm_set1_ps(lane_error)};
+    const lanes4 direction_norm{_mm_set1_ps(ray.direction_norm)};
+    const auto det_error = mul(mul(error, direction_norm), edge_product);
+    const auto uv_error = mul(mul(mul(error, direction_norm), position_norm), load(tri.edge_sum));
+    const auto t_error = mul(mul(error, position_norm), edge_product);
+
+    // rounded up so that the comparison stays conservative
+    const lanes4 t_max_f{_mm_set1_ps(t_max * (1.0f + 0x1p-22f))};
+
+    const lanes4 zero{_mm_setzero_ps()};
+    const auto less_equal = [](lanes4 a, lanes4 b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); };
+    const int uncertain = less_equal(abs_det, det_error);
+    const int inside = less_equal(sub(zero, uv_error), u)
+                     & less_equal(sub(zero, uv_error), v)
+                     & less_equal(add(u, v), add(add(add(abs_det, det_error), uv_error), uv_error))
+                     & less_equal(sub(zero, t_error), t)
+                     & less_equal(t, add(mul(t_max_f, add(abs_det, det_error)), t_error));
+
+    return (inside | uncertain) & ((1 << count) - 1);
+}
+
+// Both halves of an axis shrink the [t_near, -t_far] interval with a max,
+// the far one through the negated inverse direction (see box4_ray)
+int box4(const float* bounds_min, const float* bounds_max, const box4_ray& ray,
+         float t_min, float t_max, float* t_near) {
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+#ifdef KERNEL_AVX2
+    auto interval = join(_mm_set1_ps(t_min), _mm_set1_ps(-t_max));
+    for (int a = 0; a < 3; ++a) {
+        const float* near_bounds = (ray.dir_is_neg[a] ? bounds_max : bounds_min) + 4*a;
+        const float* far_bounds = (ray.dir_is_neg[a] ? bounds_min : bounds_max) + 4*a;
+        const __m256 bounds = join(_mm_load_ps(near_bounds), _mm_load_ps(far_bounds));
+        const __m256 t = _mm256_mul_ps(_mm256_sub_ps(bounds, _mm256_load_ps(ray.origin[a])), _mm256_load_ps(ray.inv_dir[a]));
+        interval = _mm256_max_ps(t, interval);
+    }
+    const __m128 near = _mm256_castps256_ps128(interval);
+    const __m128 far = _mm_xor_ps(_mm256_extractf128_ps(interval, 1), sign_bit);
+#else
+    __m128 near = _mm_set1_ps(t_min);
+    __m128 far = _mm_set1_ps(-t_max);
+    for (int a = 0; a < 3; ++a) {
+        const float* near_bounds = (ray.dir_is_neg[a] ? bounds_max : bounds_min) + 4*a;
+        const float* far_bounds = (ray.dir_is_neg[a] ? bounds_min : bounds_max) + 4*a;
+        near = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_bounds), _mm_load_ps(ray.origin[a])), _mm_load_ps(ray.inv_dir[a])), near);
+        far = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_bounds), _mm_load_ps(ray.origin[a] + 4)), _mm_load_ps(ray.inv_dir[a] + 4)), far);
+    }
+    far = _mm_xor_ps(far, sign_bit);
+#endif
+    _mm_storeu_ps(t_near, near);
+    return _mm_movemask_ps(_mm_cmple_ps(near, _mm_mul_ps(far, _mm_set1_ps(box4_far_scale))));
+}
+
+void color_bytes(std::uint8_t* out, const real* rgb, int samples) {
+    // Divide the color by the number of samples, gamma-correct for gamma=2.0
+    // and clamp to [0,0.999] before the [0,255] truncation.
+    const double scale = 1.0 / samples;
+    alignas(16) std::int32_t bytes[4];
+#ifdef KERNEL_AVX2
+    const __m256d c = _mm256_setr_pd(static_cast<double>(rgb[0]), static_cast<double>(rgb[1]),
+                                     static_cast<double>(rgb[2]), 0.0);
+    const __m256d gamma = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_set1_pd(scale), c));
+    const __m256d clamped = _mm256_min_pd(_mm256_max_pd(gamma, _mm256_setzero_pd()), _mm256_set1_pd(0.999));
+    _mm_store_si128(reinterpret_cast<__m128i*>(bytes), _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_set1_pd(256.0), clamped)));
+#else
+    const auto convert = [scale](__m128d c) {
+        const __m128d gamma = _mm_sqrt_pd(_mm_mul_pd(_mm_set1_pd(scale), c));
+        const __m128d clamped = _mm_min_pd(_mm_max_pd(gamma, _mm_setzero_pd()), _mm_set1_pd(0.999));
+        return _mm_cvttpd_epi32(_mm_mul_pd(_mm_set1_pd(256.0), clamped));
+    };
+    const __m128i rg = convert(_mm_setr_pd(static_cast<double>(rgb[0]), static_cast<double>(rgb[1])));
+    const __m128i b = convert(_mm_set_sd(static_cast<double>(rgb[2])));
+    _mm_store_si128(reinterpret_cast<__m128i*>(bytes), _mm_unpacklo_epi64(rg, b));
+#endif
+    out[0] = static_cast<std::uint8_t>(bytes[0]);
+    out[1] = static_cast<std::uint8_t>(bytes[1]);
+    out[2] = static_cast<std::uint8_t>(bytes[2]);
+}
+
+#else
+
+// Plain lane by lane versions, for the targets without SSE
+
+int triangle4(const triangle4_arrays& tri, std::uint32_t first, std::uint32_t count,
+              const triangle4_ray& ray, float t_max) {
+    const xyz<float> direction{ray.direction[0], ray.direction[1], ray.direction[2]};
+    const xyz<float> origin{ray.origin[0], ray.origin[1], ray.origin[2]};
+    const float t_max_f = t_max * (1.0f + 0x1p-22f);
+    int mask = 0;
+    for (std::uint32_t k = 0; k < count; ++k) {
+        const auto i = first + k;
+        const xyz<float> v0{tri.v0[0][i], tri.v0[1][i], tri.v0[2][i]};
+        const xyz<float> e1{tri.e1[0][i], tri.e1[1][i], tri.e1[2][i]};
+        const xyz<float> e2{tri.e2[0][i], tri.e2[1][i], tri.e2[2][i]};
+        const auto tvec = sub(origin, v0);
+        const auto pvec = cross(direction, e2);
+        const auto qvec = cross(tvec, e1);
+        const float det = dot(e1, pvec);
+        const float sign = std::copysign(1.0f, det);
+        const float u = sign*dot(tvec, pvec);
+        const float v = sign*dot(direction, qvec);
+        const float t = sign*dot(e2, qvec);
+        const float abs_det = std::fabs(det);
+
+        const float position_norm = ray.origin_norm + tri.v0_norm[i];
+        const float det_error = lane_error * ray.direction_norm * tri.edge_product[i];
+        const float uv_error = lane_error * ray.direction_norm * position_norm * tri.edge_sum[i];
+        const float t_error = lane_error * position_norm * tri.edge_product[i];
+
+        const bool uncertain = abs_det <= det_error;
+        const bool inside = -uv_error <= u && -uv_error <= v && u + v <= abs_det + det_error + uv_error + uv_error
+                         && -t_error <= t && t <= t_max_f * (abs_det + det_error) + t_error;
+        if (inside || uncertain)
+            mask |= 1 << k;
+    }
+    return mask;
+}
+
+int box4(const float* bounds_min, const float* bounds_max, const box4_ray& ray,
+         float t_min, float t_max, float* t_near) {
+    int mask = 0;
+    for (int c = 0; c < 4; ++c) {
+        float near = t_min;
+        float far = -t_max;
+        for (int a = 0; a < 3; ++a) {
+            const float near_bound = (ray.dir_is_neg[a] ? bounds_max : bounds_min)[4*a + c];
+            const float far_bound = (ray.dir_is_neg[a] ? bounds_min : bounds_max)[4*a + c];
+            const float tn = (near_bound - ray.origin[a][c]) * ray.inv_dir[a][c];
+            const float tf = (far_bound - ray.origin[a][4 + c]) * ray.inv_dir[a][4 + c];
+            near = tn > near ? tn : near;
+            far = tf > far ? tf : far;
+        }
+        t_near[c] = near;
+        if (near <= -far * box4_far_scale)
+            mask |= 1 << c;
+    }
+    return mask;
+}
+
+void color_bytes(std::uint8_t* out, const real* rgb, int samples) {
+    const double scale = 1.0 / samples;
+    for (int c = 0; c < 3; ++c) {
+        const double gamma = std::sqrt(scale * static_cast<double>(rgb[c]));
+        const double clamped = gamma > 0.0 ? (gamma < 0.999 ? gamma : 0.999) : 0.0;
+        out[c] = static_cast<std::uint8_t>(256 * clamped);
+    }
+}
+
+#endif
+
+} // namespace
+
+const kernel_table KERNEL_TABLE = { KERNEL_NAME, sphere_root, triangle, triangle4, box4, color_bytes };
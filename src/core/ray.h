@@ -3,25 +3,30 @@
 
 #include "vec3.h"
 
-class ray {
+template<typename T>
+class ray_t {
     public:
-        ray() = default;
-        ray(const point3& origin, const vec3& direction, double time = 0.0)
+        using vector = vec3_t<T>;
+
+        ray_t() = default;
+        ray_t(const vector& origin, const vector& direction, T time = 0)
             : orig(origin), dir(direction), tm(time)
         {}
 
-        point3 origin() const  { return orig; }
-        vec3 direction() const { return dir; }
-        double time() const    { return tm; }
+        vector origin() const  { return orig; }
+        vector direction() const { return dir; }
+        T time() const    { return tm; }
 
-        point3 at(double t) const {
+        vector at(T t) const {
             return orig + t*dir;
         }
 
     public:
-        point3 orig;
-        vec3 dir;
-        double tm;
+        vector orig;
+        vector dir;
+        T tm;
 };
 
+using ray = ray_t<real>;
+
 #endif
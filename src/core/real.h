@@ -0,0 +1,12 @@
+#ifndef REAL_H
+#define REAL_H
+
+// Scalar type of the vector math, the rays and the geometry: single
+// precision with the RAYTRACER_FLOAT_GEOMETRY build option
+#ifdef RAYTRACER_FLOAT_GEOMETRY
+using real = float;
+#else
+using real = double;
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// PCG32 generator (https://www.pcg-random.org): 16 bytes of state, no
+// allocation and cheap to reseed, so every (pixel, sample, frame) triplet
+// can get its own independent stream.
+class pcg32 {
+    public:
+        constexpr pcg32() = default;
+        pcg32(std::uint64_t initstate, std::uint64_t initseq) { seed(initstate, initseq); }
+
+        void seed(std::uint64_t initstate, std::uint64_t initseq) {
+            state = 0;
+            inc = (initseq << 1u) | 1u;
+            next_uint();
+            state += initstate;
+            next_uint();
+        }
+
+        // Deterministic stream for a given pixel sample, independent of the
+        // thread which computes it.
+        void seed(std::uint64_t pixel, std::uint64_t sample, std::uint64_t frame) {
+            seed(mix_bits(pixel ^ mix_bits(sample ^ mix_bits(frame))), mix_bits(pixel));
+        }
+
+        std::uint32_t next_uint() {
+            const std::uint64_t old_state = state;
+            state = old_state * 6364136223846793005ULL + inc;
+            const auto xorshifted = static_cast<std::uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+            const auto rot = static_cast<std::uint32_t>(old_state >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+        }
+
+        // Returns a random real in [0,1).
+        double next_double() {
+            return next_uint() * 0x1p-32;
+        }
+
+        // Returns a random real in [0,1), from the 24 high bits so that the
+        // rounding never reaches 1.
+        float next_float() {
+            return static_cast<float>(next_uint() >> 8) * 0x1p-24f;
+        }
+
+        // splitmix64 finalizer, used to decorrelate neighbouring seeds
+        static constexpr std::uint64_t mix_bits(std::uint64_t v) {
+            v ^= v >> 31;
+            v *= 0x7fb5d329728ea185ULL;
+            v ^= v >> 27;
+            v *= 0x81dadef4bc2dd44dULL;
+            v ^= v >> 33;
+            return v;
+        }
+
+    private:
+        std::uint64_t state = 0x853c49e6748fea9bULL;
+        std::uint64_t inc = 0xda3e39cb94b95bdbULL;
+};
+
+#endif
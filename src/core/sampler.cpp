@@ -0,0 +1,269 @@
+#include "sampler.h"
+
+#include "tracer_utils.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+// [0,1) from 32 random bits, as pcg32 does
+real to_unit(std::uint32_t bits) {
+    if constexpr (std::is_same_v<real,float>)
+        return static_cast<float>(bits >> 8) * 0x1p-24f;
+    else
+        return bits * 0x1p-32;
+}
+
+// 64 bits of a seed and a value, one mix per level of the hierarchy of
+// seeds (pixel, dimension, sample)
+std::uint64_t hash(std::uint64_t seed, std::uint64_t value) {
+    return pcg32::mix_bits(seed ^ (value + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+std::uint32_t low(std::uint64_t v) { return static_cast<std::uint32_t>(v); }
+std::uint32_t high(std::uint64_t v) { return static_cast<std::uint32_t>(v >> 32); }
+
+constexpr std::uint32_t reverse_bits(std::uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// Owen scrambling of bit reversed values by hashing, every bit flipped
+// depending on the bits below it (Burley, Practical Hash-based Owen
+// Scrambling, with the hash of pbrt-v4)
+std::uint32_t owen_scramble_reversed(std::uint32_t v, std::uint32_t seed) {
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16) | 1u;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return v;
+}
+
+// Bit reversed second Sobol dimension of every index byte value, per byte
+// position: the XOR of the generator matrix columns of the set bits
+constexpr auto sobol_reversed_tables = [] {
+    std::array<std::uint32_t,32> columns{};
+    std::uint32_t v = 1u << 31;
+    for (auto& c : columns) {
+        c = v;
+        v ^= v >> 1;
+    }
+    std::array<std::array<std::uint32_t,256>,4> tables{};
+    for (size_t b = 0; b < 4; ++b)
+        for (size_t value = 0; value < 256; ++value)
+            for (size_t bit = 0; bit < 8; ++bit)
+                if (value >> bit & 1)
+                    tables[b][value] ^= reverse_bits(columns[8*b + bit]);
+    return tables;
+}();
+
+// Owen-scrambled point of the first two Sobol dimensions at the shuffled
+// index: every dimension pair is an independent 2D sequence (padding), seed
+// picking the scrambles. The first dimension is the bit reversal of the
+// index and the scrambles work on reversed bits, so both coordinates stay
+// reversed until the end. Shuffled indices use all their bits, hence the
+// tables rather than a loop over the set bits.
+std::array<std::uint32_t,2> scrambled_sobol_2d(std::uint32_t index, std::uint64_t seed) {
+    const auto& t = sobol_reversed_tables;
+    const auto shuffled = reverse_bits(owen_scramble_reversed(reverse_bits(index), low(seed)));
+    const auto y = t[0][shuffled & 0xff] ^ t[1][shuffled >> 8 & 0xff] ^ t[2][shuffled >> 16 & 0xff] ^ t[3][shuffled >> 24];
+    return {reverse_bits(owen_scramble_reversed(shuffled, high(seed))),
+            reverse_bits(owen_scramble_reversed(y, low(pcg32::mix_bits(seed))))};
+}
+
+// Element i of a pseudo-random permutation of [0,l) picked by p (Kensler,
+// Correlated Multi-Jittered Sampling)
+std::uint32_t permute(std::uint32_t i, std::uint32_t l, std::uint32_t p) {
+    std::uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;             i *= 0xe170893du;
+        i ^= p >> 16;       i ^= (i & w) >> 4;
+        i ^= p >> 8;        i *= 0x0929eb3fu;
+        i ^= p >> 23;       i ^= (i & w) >> 1;
+        i *= 1u | p >> 27;  i *= 0x6935fa69u;
+        i ^= (i & w) >> 11; i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;  i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;  i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+// Bits of (stratum + jitter) / strata
+std::uint32_t jittered(std::uint32_t stratum, std::uint32_t jitter, std::uint32_t strata) {
+    return static_cast<std::uint32_t>(((static_cast<std::uint64_t>(stratum) << 32) + jitter) / strata);
+}
+
+class independent_sampler final : public sampler {
+    public:
+        virtual real get_1d(const sample_stream&, std::uint32_t) const override {
+            return random_real();
+        }
+
+        virtual std::array<real,2> get_2d(const sample_stream&, std::uint32_t) const override {
+            const auto u1 = random_real();
+            const auto u2 = random_real();
+            return {u1, u2};
+        }
+};
+
+// 1D draws are spread over samples_per_pixel strata, 2D ones over a square
+// grid of at least as many cells, each sample index taking one stratum
+class stratified_sampler final : public sampler {
+    public:
+        explicit stratified_sampler(int samples_per_pixel)
+            : strata(static_cast<std::uint32_t>(std::max(samples_per_pixel, 1))),
+              grid(static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(strata))))) {}
+
+        virtual real get_1d(const sample_stream& stream, std::uint32_t dimension) const override {
+            const auto seed = hash(stream.pixel_seed, dimension);
+            const auto batch = stream.index / strata;
+            const auto stratum = permute(stream.index % strata, strata, low(hash(seed, batch)));
+            return to_unit(jittered(stratum, low(hash(~seed, stream.index)), strata));
+        }
+
+        virtual std::array<real,2> get_2d(const sample_stream& stream, std::uint32_t dimension) const override {
+            const auto seed = hash(stream.pixel_seed, dimension);
+            const auto cells = grid*grid;
+            const auto batch = stream.index / cells;
+            const auto cell = permute(stream.index % cells, cells, low(hash(seed, batch)));
+            const auto jitter = hash(~seed, stream.index);
+            return {to_unit(jittered(cell % grid, low(jitter), grid)),
+                    to_unit(jittered(cell / grid, high(jitter), grid))};
+        }
+
+    private:
+        std::uint32_t strata;
+        std::uint32_t grid;
+};
+
+// Scrambles differ for every pixel, dimension and frame
+class sobol_sampler final : public sampler {
+    public:
+        virtual std::array<real,2> get_2d(const sample_stream& stream, std::uint32_t dimension) const override {
+            const auto point = scrambled_sobol_2d(stream.index, hash(stream.pixel_seed, dimension));
+            return {to_unit(point[0]), to_unit(point[1])};
+        }
+};
+
+// Toroidal mask of blue_noise_size^2 ranks whose thresholds are blue noise:
+// every cell is the largest void left by the ones ranked before it, under a
+// gaussian energy (the void filling phase of Ulichney's void-and-cluster).
+constexpr int blue_noise_size = 64; // a power of two
+
+const std::vector<std::uint32_t>& blue_noise_mask() {
+    static const std::vector<std::uint32_t> mask = [] {
+        constexpr int n = blue_noise_size;
+        constexpr double sigma = 1.5;
+
+        // energy of a point on the torus, by offset
+        std::vector<double> kernel(n*n);
+        for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x) {
+                const int dx = std::min(x, n - x);
+                const int dy = std::min(y, n - y);
+                kernel[static_cast<size_t>(y*n + x)] = std::exp(-(dx*dx + dy*dy) / (2*sigma*sigma));
+            }
+        }
+
+        std::vector<double> energy(n*n, 0.0);
+        std::vector<std::uint32_t> ranks(n*n, 0);
+        std::vector<bool> filled(n*n, false);
+        int next = 0;
+        for (int rank = 0; rank < n*n; ++rank) {
+            double lowest = std::numeric_limits<double>::infinity();
+            for (int c = 0; c < n*n && rank > 0; ++c) {
+                if (!filled[static_cast<size_t>(c)] && energy[static_cast<size_t>(c)] < lowest) {
+                    lowest = energy[static_cast<size_t>(c)];
+                    next = c;
+                }
+            }
+            filled[static_cast<size_t>(next)] = true;
+            // thresholds in the middle of their bin, as 32 bit fractions
+            ranks[static_cast<size_t>(next)] = static_cast<std::uint32_t>((2*rank + 1) * (0x1p32 / (2*n*n)));
+
+            const int px = next % n;
+            const int py = next / n;
+            for (int y = 0; y < n; ++y) {
+                const double* row = kernel.data() + ((y - py) & (n - 1))*n;
+                for (int x = 0; x < n; ++x)
+                    energy[static_cast<size_t>(y*n + x)] += row[(x - px) & (n - 1)];
+            }
+        }
+        return ranks;
+    }();
+    return mask;
+}
+
+// Every pixel takes the same scrambled Sobol points, shifted modulo 1 by the
+// mask (Cranley-Patterson rotation): neighbouring pixels get well spread
+// shifts, which moves the error to high frequencies at low sample counts
+// (Georgiev & Fajardo, Blue-noise Dithered Sampling). Each coordinate reads
+// the mask at its own toroidal offset.
+class blue_noise_sampler final : public sampler {
+    public:
+        blue_noise_sampler() : mask(blue_noise_mask()) {}
+
+        virtual std::array<real,2> get_2d(const sample_stream& stream, std::uint32_t dimension) const override {
+            const auto seed = hash(pcg32::mix_bits(stream.frame), dimension);
+            const auto point = scrambled_sobol_2d(stream.index, seed);
+            const auto offsets = hash(seed, 0);
+            return {to_unit(point[0] + shift(stream, low(offsets))),
+                    to_unit(point[1] + shift(stream, high(offsets)))};
+        }
+
+    private:
+        std::uint32_t shift(const sample_stream& stream, std::uint32_t offset) const {
+            constexpr std::uint32_t wrap = blue_noise_size - 1;
+            const auto x = (stream.x + offset) & wrap;
+            const auto y = (stream.y + (offset >> 16)) & wrap;
+            return mask[static_cast<size_t>(y*blue_noise_size + x)];
+        }
+
+        const std::vector<std::uint32_t>& mask;
+};
+
+} // namespace
+
+std::unique_ptr<sampler> sampler::make(sampler_kind kind, int samples_per_pixel) {
+    switch (kind) {
+        case sampler_kind::independent: return std::make_unique<independent_sampler>();
+        case sampler_kind::stratified:  return std::make_unique<stratified_sampler>(samples_per_pixel);
+        case sampler_kind::sobol:       return std::make_unique<sobol_sampler>();
+        case sampler_kind::blue_noise:  return std::make_unique<blue_noise_sampler>();
+    }
+    return std::make_unique<independent_sampler>();
+}
+
+const char* sampler::name(sampler_kind kind) {
+    switch (kind) {
+        case sampler_kind::independent: return "independent";
+        case sampler_kind::stratified:  return "stratified";
+        case sampler_kind::sobol:       return "sobol";
+        case sampler_kind::blue_noise:  return "blue_noise";
+    }
+    return "unknown";
+}
+
+bool sampler::parse(const std::string& name, sampler_kind& kind) {
+    for (auto candidate : { sampler_kind::independent, sampler_kind::stratified, sampler_kind::sobol, sampler_kind::blue_noise }) {
+        if (name == sampler::name(candidate)) {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
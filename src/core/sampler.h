@@ -0,0 +1,84 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "real.h"
+#include "rng.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Every pixel sample is a point of a high dimensional unit cube: its
+// dimensions, pairs of coordinates, feed the pixel position, the lens, the
+// time and then the scattering of each bounce. A sampler returns any
+// dimension of any sample from (pixel, sample index, frame) alone, so that
+// a sample is the same whichever worker and engine mode computes it.
+
+enum class sampler_kind {
+    independent,    // numbers of the random stream of the sample, as thread_rng
+    stratified,     // jittered strata, shuffled per pixel and dimension
+    sobol,          // Owen-scrambled Sobol points, padded per dimension
+    blue_noise      // Sobol points shared by the pixels, rotated by a blue noise mask
+};
+
+// The camera dimensions, then bounce_dimensions per bounce: materials draw at
+// most that many 1D or 2D samples when scattering
+namespace sample_dimensions {
+    constexpr std::uint32_t pixel = 0;
+    constexpr std::uint32_t lens = 1;
+    constexpr std::uint32_t time = 2;
+    constexpr std::uint32_t camera = 3;
+    constexpr std::uint32_t per_bounce = 2;
+
+    constexpr std::uint32_t bounce(int depth) {
+        return camera + per_bounce*static_cast<std::uint32_t>(depth);
+    }
+}
+
+class sampler;
+
+// Pixel sample being computed, and its next dimension
+struct sample_stream {
+    const sampler* source = nullptr;
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+    std::uint32_t index = 0;
+    std::uint32_t dimension = 0;
+    std::uint64_t frame = 0;
+    std::uint64_t pixel_seed = 0;   // pixel and frame, hashed once per sample
+
+    void start(const sampler* _source, int _x, int _y, int _index, std::uint64_t _frame) {
+        source = _source;
+        x = static_cast<std::uint32_t>(_x);
+        y = static_cast<std::uint32_t>(_y);
+        index = static_cast<std::uint32_t>(_index);
+        dimension = 0;
+        frame = _frame;
+        pixel_seed = pcg32::mix_bits((static_cast<std::uint64_t>(y) << 32 | x) ^ pcg32::mix_bits(frame));
+    }
+};
+
+class sampler {
+    public:
+        virtual ~sampler() = default;
+
+        // First coordinate of the dimension, in [0,1)
+        virtual real get_1d(const sample_stream& stream, std::uint32_t dimension) const {
+            return get_2d(stream, dimension)[0];
+        }
+
+        // Both coordinates of the dimension, in [0,1)
+        virtual std::array<real,2> get_2d(const sample_stream& stream, std::uint32_t dimension) const = 0;
+
+        // samples_per_pixel sizes the strata, later samples are valid but
+        // stratified as a new batch
+        static std::unique_ptr<sampler> make(sampler_kind kind, int samples_per_pixel);
+
+        static const char* name(sampler_kind kind);
+
+        // kind from its name, returns false if unknown
+        static bool parse(const std::string& name, sampler_kind& kind);
+};
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TRACER_SSE 1
+    #include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+// Four single precision lanes, backed by SSE when available and by plain
+// arrays otherwise (e.g. arm64), so that callers are written once.
+class float4 {
+    public:
+        float4() = default;
+
+#ifdef TRACER_SSE
+        explicit float4(float s) : v(_mm_set1_ps(s)) {}
+        float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+        explicit float4(__m128 _v) : v(_v) {}
+
+        static float4 load(const float* p) { return float4(_mm_load_ps(p)); }
+        static float4 load_unaligned(const float* p) { return float4(_mm_loadu_ps(p)); }
+        void store(float* p) const { _mm_store_ps(p, v); }
+
+        friend float4 operator+(float4 a, float4 b) { return float4(_mm_add_ps(a.v, b.v)); }
+        friend float4 operator-(float4 a, float4 b) { return float4(_mm_sub_ps(a.v, b.v)); }
+        friend float4 operator*(float4 a, float4 b) { return float4(_mm_mul_ps(a.v, b.v)); }
+        friend float4 operator/(float4 a, float4 b) { return float4(_mm_div_ps(a.v, b.v)); }
+        friend float4 operator-(float4 a) { return float4(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+
+        // NaN lanes of `a` yield `b`, which keeps slab tests conservative
+        friend float4 min(float4 a, float4 b) { return float4(_mm_min_ps(a.v, b.v)); }
+        friend float4 max(float4 a, float4 b) { return float4(_mm_max_ps(a.v, b.v)); }
+        friend float4 abs(float4 a) { return float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+        // a with its sign flipped in the lanes where s is negative
+        friend float4 mul_sign(float4 a, float4 s) { return float4(_mm_xor_ps(a.v, _mm_and_ps(s.v, _mm_set1_ps(-0.0f)))); }
+        // lanes of a where s is negative (sign bit set), lanes of b elsewhere
+        friend float4 select_negative(float4 s, float4 a, float4 b) {
+            const __m128 m = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(s.v), 31));
+            return float4(_mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)));
+        }
+
+        // bit i is set when a[i] <= b[i]
+        friend int less_equal_mask(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+        // bit i is set when a[i] < b[i]
+        friend int less_mask(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+
+        // (a[0] + a[1]) + a[2], the last lane is ignored
+        friend float sum3(float4 a) {
+            const __m128 y = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1));
+            const __m128 z = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2));
+            return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(a.v, y), z));
+        }
+        // cross product of the first three lanes, the last one is a[3]*b[3] - a[3]*b[3]
+        friend float4 cross3(float4 a, float4 b) {
+            const __m128 a_yzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+            const __m128 a_zxy = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 1, 0, 2));
+            const __m128 b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+            const __m128 b_zxy = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 1, 0, 2));
+            return float4(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+        }
+
+        float operator[](int i) const {
+            alignas(16) float lanes[4];
+            store(lanes);
+            return lanes[i];
+        }
+
+    public:
+        __m128 v;
+#else
+        explicit float4(float s) : v{s, s, s, s} {}
+        float4(float a, float b, float c, float d) : v{a, b, c, d} {}
+
+        static float4 load(const float* p) { return float4(p[0], p[1], p[2], p[3]); }
+        static float4 load_unaligned(const float* p) { return load(p); }
+        void store(float* p) const { std::copy(v, v+4, p); }
+
+        friend float4 operator+(float4 a, float4 b) { return {a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3]}; }
+        friend float4 operator-(float4 a, float4 b) { return {a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3]}; }
+        friend float4 operator*(float4 a, float4 b) { return {a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3]}; }
+        friend float4 operator/(float4 a, float4 b) { return {a.v[0]/b.v[0], a.v[1]/b.v[1], a.v[2]/b.v[2], a.v[3]/b.v[3]}; }
+        friend float4 operator-(float4 a) { return {-a.v[0], -a.v[1], -a.v[2], -a.v[3]}; }
+
+        friend float4 min(float4 a, float4 b) {
+            return {a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]};
+        }
+        friend float4 max(float4 a, float4 b) {
+            return {a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]};
+        }
+        friend float4 abs(float4 a) { return {std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3])}; }
+        friend float4 mul_sign(float4 a, float4 s) {
+            return {std::copysign(1.0f, s.v[0])*a.v[0], std::copysign(1.0f, s.v[1])*a.v[1],
+                    std::copysign(1.0f, s.v[2])*a.v[2], std::copysign(1.0f, s.v[3])*a.v[3]};
+        }
+        friend float4 select_negative(float4 s, float4 a, float4 b) {
+            return {std::signbit(s.v[0]) ? a.v[0] : b.v[0], std::signbit(s.v[1]) ? a.v[1] : b.v[1],
+                    std::signbit(s.v[2]) ? a.v[2] : b.v[2], std::signbit(s.v[3]) ? a.v[3] : b.v[3]};
+        }
+
+        friend int less_equal_mask(float4 a, float4 b) {
+            return (a.v[0] <= b.v[0] ? 1 : 0) | (a.v[1] <= b.v[1] ? 2 : 0)
+                 | (a.v[2] <= b.v[2] ? 4 : 0) | (a.v[3] <= b.v[3] ? 8 : 0);
+        }
+        friend int less_mask(float4 a, float4 b) {
+            return (a.v[0] < b.v[0] ? 1 : 0) | (a.v[1] < b.v[1] ? 2 : 0)
+                 | (a.v[2] < b.v[2] ? 4 : 0) | (a.v[3] < b.v[3] ? 8 : 0);
+        }
+
+        friend float sum3(float4 a) { return a.v[0] + a.v[1] + a.v[2]; }
+        friend float4 cross3(float4 a, float4 b) {
+            return {a.v[1]*b.v[2] - a.v[2]*b.v[1], a.v[2]*b.v[0] - a.v[0]*b.v[2],
+                    a.v[0]*b.v[1] - a.v[1]*b.v[0], a.v[3]*b.v[3] - a.v[3]*b.v[3]};
+        }
+
+        float operator[](int i) const { return v[i]; }
+
+    public:
+        float v[4];
+#endif
+};
+
+// Four double precision lanes, as a pair of SSE2 registers or plain arrays.
+// A single AVX register was not faster on the scenes, where most vectors
+// are also read one coordinate at a time, and would make the layout depend
+// on the instruction set the translation unit is compiled for.
+class double4 {
+    public:
+        double4() = default;
+
+#ifdef TRACER_SSE
+        explicit double4(double s) : xy(_mm_set1_pd(s)), zw(xy) {}
+        double4(double a, double b, double c, double d) : xy(_mm_setr_pd(a, b)), zw(_mm_setr_pd(c, d)) {}
+        double4(__m128d _xy, __m128d _zw) : xy(_xy), zw(_zw) {}
+
+        static double4 load(const double* p) { return {_mm_load_pd(p), _mm_load_pd(p + 2)}; }
+        void store(double* p) const {
+            _mm_store_pd(p, xy);
+            _mm_store_pd(p + 2, zw);
+        }
+
+        friend double4 operator+(double4 a, double4 b) { return {_mm_add_pd(a.xy, b.xy), _mm_add_pd(a.zw, b.zw)}; }
+        friend double4 operator-(double4 a, double4 b) { return {_mm_sub_pd(a.xy, b.xy), _mm_sub_pd(a.zw, b.zw)}; }
+        friend double4 operator*(double4 a, double4 b) { return {_mm_mul_pd(a.xy, b.xy), _mm_mul_pd(a.zw, b.zw)}; }
+        friend double4 operator/(double4 a, double4 b) { return {_mm_div_pd(a.xy, b.xy), _mm_div_pd(a.zw, b.zw)}; }
+        friend double4 operator-(double4 a) {
+            const __m128d sign = _mm_set1_pd(-0.0);
+            return {_mm_xor_pd(a.xy, sign), _mm_xor_pd(a.zw, sign)};
+        }
+
+        friend double4 min(double4 a, double4 b) { return {_mm_min_pd(a.xy, b.xy), _mm_min_pd(a.zw, b.zw)}; }
+        friend double4 max(double4 a, double4 b) { return {_mm_max_pd(a.xy, b.xy), _mm_max_pd(a.zw, b.zw)}; }
+        friend double4 abs(double4 a) {
+            const __m128d sign = _mm_set1_pd(-0.0);
+            return {_mm_andnot_pd(sign, a.xy), _mm_andnot_pd(sign, a.zw)};
+        }
+
+        friend int less_mask(double4 a, double4 b) {
+            return _mm_movemask_pd(_mm_cmplt_pd(a.xy, b.xy)) | (_mm_movemask_pd(_mm_cmplt_pd(a.zw, b.zw)) << 2);
+        }
+
+        friend double sum3(double4 a) {
+            return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(a.xy, _mm_unpackhi_pd(a.xy, a.xy)), a.zw));
+        }
+        friend double4 cross3(double4 a, double4 b) {
+            // (y, z | x, w) and (z, x | y, w) from the two halves
+            const double4 a_yzx{_mm_shuffle_pd(a.xy, a.zw, 1), _mm_shuffle_pd(a.xy, a.zw, 2)};
+            const double4 a_zxy{_mm_unpacklo_pd(a.zw, a.xy), _mm_shuffle_pd(a.xy, a.zw, 3)};
+            const double4 b_yzx{_mm_shuffle_pd(b.xy, b.zw, 1), _mm_shuffle_pd(b.xy, b.zw, 2)};
+            const double4 b_zxy{_mm_unpacklo_pd(b.zw, b.xy), _mm_shuffle_pd(b.xy, b.zw, 3)};
+            return a_yzx*b_zxy - a_zxy*b_yzx;
+        }
+
+    public:
+        __m128d xy;
+        __m128d zw;
+#else
+        explicit double4(double s) : v{s, s, s, s} {}
+        double4(double a, double b, double c, double d) : v{a, b, c, d} {}
+
+        static double4 load(const double* p) { return double4(p[0], p[1], p[2], p[3]); }
+        void store(double* p) const { std::copy(v, v+4, p); }
+
+        friend double4 operator+(double4 a, double4 b) { return {a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3]}; }
+        friend double4 operator-(double4 a, double4 b) { return {a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3]}; }
+        friend double4 operator*(double4 a, double4 b) { return {a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3]}; }
+        friend double4 operator/(double4 a, double4 b) { return {a.v[0]/b.v[0], a.v[1]/b.v[1], a.v[2]/b.v[2], a.v[3]/b.v[3]}; }
+        friend double4 operator-(double4 a) { return {-a.v[0], -a.v[1], -a.v[2], -a.v[3]}; }
+
+        friend double4 min(double4 a, double4 b) {
+            return {a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]};
+        }
+        friend double4 max(double4 a, double4 b) {
+            return {a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]};
+        }
+        friend double4 abs(double4 a) { return {std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3])}; }
+
+        friend int less_mask(double4 a, double4 b) {
+            return (a.v[0] < b.v[0] ? 1 : 0) | (a.v[1] < b.v[1] ? 2 : 0)
+                 | (a.v[2] < b.v[2] ? 4 : 0) | (a.v[3] < b.v[3] ? 8 : 0);
+        }
+
+        friend double sum3(double4 a) { return a.v[0] + a.v[1] + a.v[2]; }
+        friend double4 cross3(double4 a, double4 b) {
+            return {a.v[1]*b.v[2] - a.v[2]*b.v[1], a.v[2]*b.v[0] - a.v[0]*b.v[2],
+                    a.v[0]*b.v[1] - a.v[1]*b.v[0], a.v[3]*b.v[3] - a.v[3]*b.v[3]};
+        }
+
+    public:
+        double v[4];
+#endif
+};
+
+// The four lanes type of a scalar, for the padded vectors
+template<typename T> struct simd_lanes {};
+template<> struct simd_lanes<float> { using type = float4; };
+template<> struct simd_lanes<double> { using type = double4; };
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef TRACER_CONSTANTS_H
 #define TRACER_CONSTANTS_H
 
+#include <cstddef>
+
 namespace tracer_constants
 {
     constexpr auto aspect_ratio = 4.0 / 3.0;
@@ -11,7 +13,21 @@ namespace tracer_constants
     constexpr bool stack_alloc = true;
     constexpr int samples_per_pixel = 100;
     constexpr int max_depth = 50;
+    constexpr int roulette_depth = 3; // bounces before russian roulette kicks in
     constexpr bool progress_gui = true;
+    constexpr int tile_size = 16;
+    constexpr int progressive_pass_samples = 4; // samples per pixel added by each progressive pass
+    constexpr int adaptive_min_samples = 16; // variance adaptive: samples before the error is trusted
+    constexpr int adaptive_pass_samples = 8; // variance adaptive: samples added to unconverged pixels per pass
+    constexpr double adaptive_error_threshold = 1.0/256.0; // variance adaptive: target display space standard error
+    constexpr int wavefront_size = 4096; // wavefront: paths in flight per worker
+    constexpr bool use_wide_bvh = true; // traverse a 4-wide BVH collapsed from the binary one
+    constexpr size_t thread_count = 0; // 0 means std::thread::hardware_concurrency()
+#ifdef RAYTRACER_TRAVERSAL_STATS
+    constexpr bool traversal_statistics = true; // count BVH nodes and hittable tests per worker
+#else
+    constexpr bool traversal_statistics = false; // enabled by the RAYTRACER_TRAVERSAL_STATS build option
+#endif
 }
 
 #endif
\ No newline at end of file
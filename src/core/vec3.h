@@ -1,163 +1,348 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include "simd.h"
 #include "tracer_utils.h"
 
 #include <algorithm>
 #include <cmath>
 #include <iostream>
-
-class vec3 {
+#include <limits>
+#include <type_traits>
+
+// 3D vector templated on its scalar type. Scalars of other arithmetic types
+// are converted to it, so that double literals and expressions mix with
+// single precision vectors.
+template<typename T>
+class vec3_t {
     public:
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+        using scalar = T;
+
+        vec3_t() : e{0,0,0} {}
+        template<typename A, typename B, typename C>
+        vec3_t(A e0, B e1, C e2) : e{static_cast<T>(e0), static_cast<T>(e1), static_cast<T>(e2)} {}
 
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
 
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
+        vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
 
-        vec3& operator+=(const vec3 &v) {
+        vec3_t& operator+=(const vec3_t &v) {
             e[0] += v.e[0];
             e[1] += v.e[1];
             e[2] += v.e[2];
             return *this;
         }
 
-        vec3& operator*=(const double t) {
-            e[0] *= t;
-            e[1] *= t;
-            e[2] *= t;
+        template<typename S>
+        vec3_t& operator*=(const S t) {
+            const auto s = static_cast<T>(t);
+            e[0] *= s;
+            e[1] *= s;
+            e[2] *= s;
             return *this;
         }
 
-        vec3& operator/=(const double t) {
-            return *this *= 1/t;
+        template<typename S>
+        vec3_t& operator/=(const S t) {
+            return *this *= 1/static_cast<T>(t);
         }
 
-        double length() const {
+        T length() const {
             return std::sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
     
         bool near_zero() const {
             // Return true if the vector is close to zero in all dimensions.
-            const auto s = 1e-8;
+            const auto s = static_cast<T>(1e-8);
             return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
         }
     
-        inline static vec3 random() {
-            return vec3(random_double(), random_double(), random_double());
+        inline static vec3_t random() {
+            return vec3_t(random_real(), random_real(), random_real());
+        }
+
+        inline static vec3_t random(real min, real max) {
+            return vec3_t(random_real(min,max), random_real(min,max), random_real(min,max));
+        }
+
+    public:
+        T e[3];
+};
+
+// float and double vectors are padded to four SIMD lanes, the last one kept at
+// zero: the arithmetic, dot and cross products are one or two instructions per
+// lane group instead of three scalar ones, for 33% more memory per vector.
+// The coordinates are stored as an aligned array, loaded to and stored from
+// the lanes around every operation (the compilers keep them in registers).
+template<typename T>
+concept simd_scalar = requires { typename simd_lanes<T>::type; };
+
+template<simd_scalar T>
+class vec3_t<T> {
+    public:
+        using scalar = T;
+        using lanes_t = typename simd_lanes<T>::type;
+
+        vec3_t() : e{0,0,0,0} {}
+        template<typename A, typename B, typename C>
+        vec3_t(A e0, B e1, C e2) : e{static_cast<T>(e0), static_cast<T>(e1), static_cast<T>(e2), T(0)} {}
+        explicit vec3_t(lanes_t values) { values.store(e); }
+
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
+        lanes_t lanes() const { return lanes_t::load(e); }
+
+        vec3_t operator-() const { return vec3_t(-lanes()); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
+
+        vec3_t& operator+=(const vec3_t &v) {
+            (lanes() + v.lanes()).store(e);
+            return *this;
+        }
+
+        template<typename S>
+        vec3_t& operator*=(const S t) {
+            (lanes() * lanes_t(static_cast<T>(t))).store(e);
+            return *this;
+        }
+
+        template<typename S>
+        vec3_t& operator/=(const S t) {
+            return *this *= 1/static_cast<T>(t);
+        }
+
+        T length() const {
+            return std::sqrt(length_squared());
         }
 
-        inline static vec3 random(double min, double max) {
-            return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+        T length_squared() const {
+            const auto m = lanes();
+            return sum3(m*m);
         }
 
+        bool near_zero() const {
+            // Return true if the vector is close to zero in all dimensions.
+            return (less_mask(abs(lanes()), lanes_t(static_cast<T>(1e-8))) & 7) == 7;
+        }
+
+        inline static vec3_t random() {
+            return vec3_t(random_real(), random_real(), random_real());
+        }
+
+        inline static vec3_t random(real min, real max) {
+            return vec3_t(random_real(min,max), random_real(min,max), random_real(min,max));
+        }
+
+        // preferred over the generic templates below, which still serve the
+        // scalars of other types through the conversion to T
+        friend vec3_t operator+(const vec3_t &u, const vec3_t &v) { return vec3_t(u.lanes() + v.lanes()); }
+        friend vec3_t operator-(const vec3_t &u, const vec3_t &v) { return vec3_t(u.lanes() - v.lanes()); }
+        friend vec3_t operator*(const vec3_t &u, const vec3_t &v) { return vec3_t(u.lanes() * v.lanes()); }
+        friend vec3_t operator*(T t, const vec3_t &v) { return vec3_t(lanes_t(t) * v.lanes()); }
+        friend T dot(const vec3_t &u, const vec3_t &v) { return sum3(u.lanes() * v.lanes()); }
+        friend vec3_t cross(const vec3_t &u, const vec3_t &v) { return vec3_t(cross3(u.lanes(), v.lanes())); }
+        friend vec3_t min(const vec3_t &u, const vec3_t &v) { return vec3_t(min(u.lanes(), v.lanes())); }
+        friend vec3_t max(const vec3_t &u, const vec3_t &v) { return vec3_t(max(u.lanes(), v.lanes())); }
+
     public:
-        double e[3];
+        alignas(16) T e[4];
 };
 
 // Type aliases for vec3
+using vec3 = vec3_t<real>;
 using point3 = vec3;   // 3D point
 using color = vec3;    // RGB color
 
 // vec3 Utility Functions
 
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
+template<typename T>
+inline std::ostream& operator<<(std::ostream &out, const vec3_t<T> &v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template<typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template<typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template<typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+template<typename T, typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+inline vec3_t<T> operator*(S t, const vec3_t<T> &v) {
+    if constexpr (std::is_same_v<S,T>)
+        return vec3_t<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
+    else
+        return static_cast<T>(t) * v;
 }
 
-inline vec3 operator*(const vec3 &v, double t) {
+template<typename T, typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+inline vec3_t<T> operator*(const vec3_t<T> &v, S t) {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t) {
-    return (1/t) * v;
+template<typename T, typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+inline vec3_t<T> operator/(vec3_t<T> v, S t) {
+    return (1/static_cast<T>(t)) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v) {
+template<typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+template<typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v) {
+template<typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v) {
     return v / v.length();
 }
 
+// Closed form warps of sample points of [0,1)^2: one point per draw, without
+// rejection loops nor data dependent branches,
+// so that stratified or low-discrepancy points keep their distribution.
+
+// Sine and cosine of |x| <= pi/4 by their Taylor polynomials, within 2e-9:
+// no range reduction is needed, and the sampling paths do not need the
+// precision of the library calls, several times slower.
+template<typename T>
+inline void sin_cos_quarter(T x, T& s, T& c) {
+    const T x2 = x*x;
+    s = x*(1 + x2*(T(-1.0/6) + x2*(T(1.0/120) + x2*(T(-1.0/5040) + x2*T(1.0/362880)))));
+    c = 1 + x2*(T(-1.0/2) + x2*(T(1.0/24) + x2*(T(-1.0/720) + x2*(T(1.0/40320) + x2*T(-1.0/3628800)))));
+}
+
+// Uniform point in the unit disk of the xy plane, by the concentric mapping
+// of the square (Shirley & Chiu, A Low Distortion Map Between Disk and Square)
+template<typename T>
+inline vec3_t<T> sample_concentric_disk(T u1, T u2) {
+    const T a = 2*u1 - 1;
+    const T b = 2*u2 - 1;
+
+    // the offset of larger magnitude is the radius, the ratio of the other
+    // one the angle from the x axis (horizontal) or from the y axis, taken in
+    // the first octant and signed back: min, max and copysign, no branches
+    const T abs_a = std::abs(a);
+    const T abs_b = std::abs(b);
+    const T r = std::max(abs_a, abs_b);
+    const T ratio = std::min(abs_a, abs_b) / std::max(r, std::numeric_limits<T>::min());
+    T s, c;
+    sin_cos_quarter(static_cast<T>(pi)/4*ratio, s, c);
+    const T horizontal = abs_a > abs_b;
+    const T x = s + horizontal*(c - s);
+    const T y = c + horizontal*(s - c);
+    return vec3_t<T>(std::copysign(r*x, a), std::copysign(r*y, b), 0);
+}
+
+// Uniform direction on the unit sphere: the disk point mapped by preserving
+// areas, z = 1 - 2*|p|^2 being uniform
+template<typename T>
+inline vec3_t<T> sample_uniform_sphere(T u1, T u2) {
+    const auto p = sample_concentric_disk(u1, u2);
+    const T r2 = p.length_squared();
+    const T scale = 2*std::sqrt(std::max(T(0), 1 - r2));
+    return vec3_t<T>(scale*p.x(), scale*p.y(), 1 - 2*r2);
+}
+
+// Uniform point in the unit ball, u3 picking the radius
+template<typename T>
+inline vec3_t<T> sample_uniform_ball(T u1, T u2, T u3) {
+    return std::cbrt(u3) * sample_uniform_sphere(u1, u2);
+}
+
+// Cosine weighted direction around the unit vector n: a disk point lifted to
+// the hemisphere (Malley), in a frame built without branches (Duff et al.,
+// Building an Orthonormal Basis, Revisited)
+template<typename T>
+inline vec3_t<T> sample_cosine_hemisphere(const vec3_t<T>& n, T u1, T u2) {
+    const auto d = sample_concentric_disk(u1, u2);
+    const T z = std::sqrt(std::max(T(0), 1 - d.length_squared()));
+
+    const T sign = std::copysign(T(1), n.z());
+    const T a = -1 / (sign + n.z());
+    const T b = n.x()*n.y()*a;
+    const vec3_t<T> tangent(1 + sign*n.x()*n.x()*a, sign*b, -sign*n.x());
+    const vec3_t<T> bitangent(b, sign + n.y()*n.y()*a, -n.y());
+    return d.x()*tangent + d.y()*bitangent + z*n;
+}
+
+// Same distributions from the thread generator, the draws being sequenced
+
 inline vec3 random_in_unit_sphere() {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
+    const auto u1 = random_real();
+    const auto u2 = random_real();
+    const auto u3 = random_real();
+    return sample_uniform_ball(u1, u2, u3);
 }
 
 inline vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+    const auto u1 = random_real();
+    const auto u2 = random_real();
+    return sample_uniform_sphere(u1, u2);
 }
 
 inline vec3 random_in_hemisphere(const vec3& normal) {
-    vec3 in_unit_sphere = random_in_unit_sphere();
-    if (dot(in_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
-        return in_unit_sphere;
-    else
-        return -in_unit_sphere;
+    const vec3 on_sphere = random_unit_vector();
+    // flipped into the hemisphere of the normal
+    return std::copysign(real(1), dot(on_sphere, normal)) * on_sphere;
+}
+
+inline vec3 random_cosine_direction(const vec3& normal) {
+    const auto u1 = random_real();
+    const auto u2 = random_real();
+    return sample_cosine_hemisphere(normal, u1, u2);
 }
 
 inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
+    const auto u1 = random_real();
+    const auto u2 = random_real();
+    return sample_concentric_disk(u1, u2);
 }
 
-inline vec3 reflect(const vec3& v, const vec3& n) {
+template<typename T>
+inline vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n) {
     return v - 2*dot(v,n)*n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    auto cos_theta = std::min(dot(-uv, n), 1.0);
-    vec3 r_out_perp =  etai_over_etat * (uv + cos_theta*n);
-    vec3 r_out_parallel = -std::sqrt(std::abs(1.0 - r_out_perp.length_squared())) * n;
+template<typename T>
+inline vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, T etai_over_etat) {
+    auto cos_theta = std::min(dot(-uv, n), T(1));
+    vec3_t<T> r_out_perp =  etai_over_etat * (uv + cos_theta*n);
+    vec3_t<T> r_out_parallel = -std::sqrt(std::abs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
-inline vec3 min(const vec3& v1, const vec3& v2) {
+template<typename T>
+inline vec3_t<T> min(const vec3_t<T>& v1, const vec3_t<T>& v2) {
     return { std::min(v1.x(),v2.x()), std::min(v1.y(),v2.y()), std::min(v1.z(),v2.z()) };
 }
 
-inline vec3 max(const vec3& v1, const vec3& v2) {
+template<typename T>
+inline vec3_t<T> max(const vec3_t<T>& v1, const vec3_t<T>& v2) {
     return { std::max(v1.x(),v2.x()), std::max(v1.y(),v2.y()), std::max(v1.z(),v2.z()) };
 }
 
@@ -17,7 +17,7 @@ class camera {
             double _time1 = 0)
         {
             auto theta = degrees_to_radians(vfov);
-            auto h = tan(theta/2);
+            auto h = std::tan(theta/2);
             auto viewport_height = 2.0 * h;
             auto viewport_width = aspect_ratio * viewport_height;
             
@@ -30,19 +30,25 @@ class camera {
             vertical = focus_dist * viewport_height * v;
             lower_left_corner = origin - horizontal/2 - vertical/2 - focus_dist*w;
 
-            lens_radius = aperture / 2;
-            time0 = _time0;
-            time1 = _time1;
+            lens_radius = static_cast<real>(aperture / 2);
+            time0 = static_cast<real>(_time0);
+            time1 = static_cast<real>(_time1);
         }
 
-        ray get_ray(double s, double t) const {
-            vec3 rd = lens_radius * random_in_unit_disk();
-            vec3 offset = u * rd.x() + v * rd.y();
+        ray get_ray(real s, real t) const {
+            // the lens point is always drawn, so that the sample sequence does
+            // not depend on the aperture, but only warped through a real lens
+            const auto [u1, u2] = next_sample_2d();
+            vec3 offset;
+            if (lens_radius > 0) {
+                vec3 rd = lens_radius * sample_concentric_disk(u1, u2);
+                offset = u * rd.x() + v * rd.y();
+            }
 
             return ray(
                origin + offset,
                lower_left_corner + s*horizontal + t*vertical - origin - offset,
-               random_double(time0, time1)
+               time0 + (time1-time0)*next_sample_1d()
             );
         }
 
@@ -52,8 +58,8 @@ class camera {
         vec3 horizontal;
         vec3 vertical;
         vec3 u, v, w;
-        double lens_radius;
-        double time0, time1;  // shutter open/close times
+        real lens_radius;
+        real time0, time1;  // shutter open/close times
 };
 
 #endif
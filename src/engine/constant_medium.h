@@ -7,44 +7,54 @@
 #include "material.h"
 #include "texture.h"
 
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <utility>
+
 class constant_medium final : public hittable {
     public:
-        constant_medium(std::shared_ptr<hittable> b, double d, std::shared_ptr<texture> a)
+        constant_medium(std::shared_ptr<hittable> b, real d, std::shared_ptr<texture> a)
             : boundary(b),
               neg_inv_density(-1/d),
               phase_function(std::make_shared<isotropic>(a))
             {}
 
-        constant_medium(std::shared_ptr<hittable> b, double d, color c)
+        constant_medium(std::shared_ptr<hittable> b, real d, color c)
             : boundary(b),
               neg_inv_density(-1/d),
               phase_function(std::make_shared<isotropic>(c))
             {}
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
 
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override {
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override {
             return boundary->bounding_box(time0, time1, output_box);
         }
 
     public:
         std::shared_ptr<hittable> boundary;
-        double neg_inv_density;
+        real neg_inv_density;
         std::shared_ptr<material> phase_function;
 };
 
-bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+inline bool constant_medium::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     // Print occasional samples when debugging. To enable, set enableDebug true.
     const bool enable_debug = false;
-    const bool debugging = enable_debug && random_double() < 0.00001;
+    const bool debugging = enable_debug && random_real() < 0.00001;
 
     hit_record rec1, rec2;
 
     if (!boundary->hit(r, -infinity, infinity, rec1))
         return false;
 
-    if (!boundary->hit(r, rec1.t+0.0001, infinity, rec2))
+    // the gap must stay above the rounding of far boundaries in single precision
+    const auto gap = std::max(real(0.0001), 4*std::numeric_limits<real>::epsilon()*std::fabs(rec1.t));
+    if (!boundary->hit(r, rec1.t+gap, infinity, rec2))
         return false;
 
     if (debugging) std::cerr << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << '\n';
@@ -60,7 +70,7 @@ bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record&
 
     const auto ray_length = r.direction().length();
     const auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-    const auto hit_distance = neg_inv_density * log(random_double());
+    const auto hit_distance = neg_inv_density * std::log(random_real());
 
     if (hit_distance > distance_inside_boundary)
         return false;
@@ -76,9 +86,35 @@ bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record&
 
     rec.normal = vec3(1,0,0);  // arbitrary
     rec.front_face = true;     // also arbitrary
-    rec.mat_ptr = phase_function;
+    rec.mat_ptr = phase_function.get();
 
     return true;
 }
 
+// Lanes traced one after the other, each drawing the scattering distance
+// from its own random stream
+inline int constant_medium::hit_packet(const ray_packet& packet, int mask, real t_min,
+                                       packet_distances& t_max, packet_records& rec) const {
+    int hits = 0;
+    hit_record temp_rec;
+    for (auto lanes = static_cast<unsigned>(mask); lanes != 0; lanes &= lanes - 1) {
+        const auto k = std::countr_zero(lanes);
+        const auto lane = static_cast<size_t>(k);
+
+        auto* stream = packet.streams[lane];
+        if (stream)
+            std::swap(thread_rng(), *stream);
+        const bool hit_lane = hit(packet.rays[lane], t_min, t_max[lane], temp_rec);
+        if (stream)
+            std::swap(thread_rng(), *stream);
+
+        if (hit_lane) {
+            rec[lane] = temp_rec;
+            t_max[lane] = temp_rec.t;
+            hits |= 1 << k;
+        }
+    }
+    return hits;
+}
+
 #endif
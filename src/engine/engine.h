@@ -4,28 +4,129 @@
 #include "frame_allocator.h"
 #include "gui.h"
 #include "material.h"
+#include "path_statistics.h"
 #include "hittable_list.h"
-#include "threadpool.h"
-
+#include "tile_scheduler.h"
+#include "trace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// every mode is dispatched as tiles on a work-stealing tile_scheduler
 enum class engine_mode
     {
-        single,
-        adaptive,
-        parallel_stripes,
-        parallel_images
+        single,             // tiles rendered on a single worker
+        adaptive,           // corner-based adaptive subsampling
+        parallel_stripes,   // full sampling, tiles shared by all workers
+        sample_slices,      // samples split in one slice per worker, accumulated per tile
+        progressive,        // sample passes published one after the other, within a time budget
+        variance_adaptive,  // per-pixel sampling until the estimated error meets a target
+        wavefront           // tile paths traced bounce by bounce through ray queues
+    };
+
+constexpr std::array<engine_mode,7> engine_modes{
+    engine_mode::single, engine_mode::adaptive, engine_mode::parallel_stripes, engine_mode::sample_slices,
+    engine_mode::progressive, engine_mode::variance_adaptive, engine_mode::wavefront };
+
+inline const char* engine_mode_name(engine_mode mode)
+{
+    switch (mode) {
+        case engine_mode::single:               return "single";
+        case engine_mode::adaptive:             return "adaptive";
+        case engine_mode::parallel_stripes:     return "parallel_stripes";
+        case engine_mode::sample_slices:        return "sample_slices";
+        case engine_mode::progressive:          return "progressive";
+        case engine_mode::variance_adaptive:    return "variance_adaptive";
+        case engine_mode::wavefront:            return "wavefront";
+    }
+    return "unknown";
+}
+
+// mode from its name, returns false if unknown
+inline bool parse_engine_mode(const std::string& name, engine_mode& mode)
+{
+    for (auto candidate : engine_modes) {
+        if (name == engine_mode_name(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// optional per-pixel cost recorded while sampling
+enum class cost_metric
+    {
+        none,
+        time,               // wall time spent in the pixel samples, in microseconds
+        traversal           // BVH nodes visited plus hittables tested (needs traversal_statistics)
     };
 
-template<int image_width, int image_height, int color_channels>
+// gui_t shows the progressive rendering, dynamic_gui_stub keeps the engine headless
+template<int image_width, int image_height, int color_channels, typename gui_t = dynamic_gui>
 class engine
 {
 public:
-    engine( const camera& _cam, engine_mode _m) : m(_m), cam(_cam) {}
+    static constexpr int frame_size = image_width * image_height * color_channels;
+
+    engine( const camera& _cam, engine_mode _m, size_t _thread_count = tracer_constants::thread_count)
+        : m(_m), cam(_cam), thread_count(_thread_count) {}
     
     void set_scene(hittable_list _world, color _background)
     {
         world = _world;
         background = _background;
     }
+
+    // Frame index mixed in the per-sample random streams: renders are
+    // reproducible for a given frame and decorrelated between frames.
+    void set_frame(std::uint64_t _frame)
+    {
+        frame = _frame;
+    }
+
+    void set_samples_per_pixel(int _samples_per_pixel)
+    {
+        samples_per_pixel = _samples_per_pixel;
+        pixel_sampler = sampler::make(sampling, samples_per_pixel);
+    }
+
+    // Sampler of the camera, lens, time and scattering dimensions of the
+    // pixel samples, built for the samples per pixel count and kept until
+    // one of them changes
+    void set_sampler(sampler_kind _sampling)
+    {
+        sampling = _sampling;
+        pixel_sampler = sampler::make(sampling, samples_per_pixel);
+    }
+
+    // Wall-clock budget of the progressive mode, zero means no deadline: the
+    // samples per pixel count is then the only limit
+    void set_time_budget(std::chrono::milliseconds _time_budget)
+    {
+        time_budget = _time_budget;
+    }
+
+    // Called by the progressive mode after every pass with the current
+    // estimate and its number of samples per pixel
+    void set_pass_callback(std::function<void(const std::uint8_t*, int)> _pass_callback)
+    {
+        pass_callback = std::move(_pass_callback);
+    }
+
+    // Record the cost of every pixel during the next runs (see cost_map)
+    void set_cost_metric(cost_metric _metric)
+    {
+        metric = _metric;
+        if (metric == cost_metric::traversal && !tracer_constants::traversal_statistics)
+            std::cerr << "traversal statistics are compiled out (RAYTRACER_TRAVERSAL_STATS), the cost map will be empty" << std::endl;
+    }
     
     int run( std::uint8_t* output_image)
     {
@@ -36,296 +137,376 @@ public:
         }
         
         std::cout << "--> engine raycasting start" << std::endl;
+        scoped_trace trace("engine run");
+
+        statistics = {};
+        rendered_samples = samples_per_pixel;
+        if (metric != cost_metric::none)
+            pixel_cost.assign(static_cast<size_t>(image_width*image_height), 0.f);
 
+        int elapsed_ms = 0;
         switch(m)
         {
         case engine_mode::single:
         default:
-            return _run_single(output_image);
+            elapsed_ms = _run_single(output_image);
+            break;
         case engine_mode::adaptive:
-            return _run_adaptive(output_image);
+            elapsed_ms = _run_adaptive(output_image);
+            break;
         case engine_mode::parallel_stripes:
-            return _run_parallel_stripes(output_image);
-        case engine_mode::parallel_images:
-            return _run_parallel_images(output_image);
+            elapsed_ms = _run_parallel_stripes(output_image);
+            break;
+        case engine_mode::sample_slices:
+            elapsed_ms = _run_sample_slices(output_image);
+            break;
+        case engine_mode::progressive:
+            elapsed_ms = _run_progressive(output_image);
+            break;
+        case engine_mode::variance_adaptive:
+            elapsed_ms = _run_variance_adaptive(output_image);
+            break;
+        case engine_mode::wavefront:
+            elapsed_ms = _run_wavefront(output_image);
+            break;
         }
 
         std::cout << "--> engine raycasting stop" << std::endl;
+
+        return elapsed_ms;
+    }
+
+    // Path statistics of the last run
+    const path_statistics& stats() const
+    {
+        return statistics;
+    }
+
+    // Samples per pixel actually rendered by the last run, the rounded mean
+    // for the variance adaptive mode
+    int rendered_samples_per_pixel() const
+    {
+        return rendered_samples;
+    }
+
+    // Per-pixel cost of the last run, row major, empty without cost metric
+    const std::vector<float>& cost_map() const
+    {
+        return pixel_cost;
     }
     
 private:
 
-    inline color _stochastic_sample(int i, int j, int _samples_per_pixel = tracer_constants::samples_per_pixel)
+    inline color _stochastic_sample(int i, int j)
+    {
+        return _stochastic_sample(i, j, samples_per_pixel, 0);
+    }
+
+    inline color _stochastic_sample(int i, int j, int _samples_per_pixel, int first_sample)
+    {
+        const auto pixel_index = static_cast<std::uint64_t>(j)*image_width + static_cast<std::uint64_t>(i);
+        return _with_cost(pixel_index, [&] {
+            return _sample_pixel(i, j, pixel_index, _samples_per_pixel, first_sample);
+        });
+    }
+
+    // Run a sampling stage, its cost being added to the pixel in the cost map
+    template<typename stage_t>
+    inline auto _with_cost(std::uint64_t pixel_index, stage_t&& stage)
+    {
+        if (metric == cost_metric::none)
+            return stage();
+
+        const auto traversal_steps = [] {
+            const auto& ts = thread_path_statistics();
+            return ts.nodes_visited + ts.hittable_tests;
+        };
+        const auto steps_before = traversal_steps();
+        const auto start = std::chrono::steady_clock::now();
+
+        const auto result = stage();
+
+        const auto cost = metric == cost_metric::time
+            ? std::chrono::duration<float,std::micro>(std::chrono::steady_clock::now() - start).count()
+            : static_cast<float>(traversal_steps() - steps_before);
+        // partial images sample the same pixel from several workers
+        std::atomic_ref<float>(pixel_cost[pixel_index]).fetch_add(cost, std::memory_order_relaxed);
+        return result;
+    }
+
+    inline color _sample_pixel(int i, int j, std::uint64_t pixel_index, int _samples_per_pixel, int first_sample)
     {
+        const sample_stream_scope samples;
         color pixel_color(0, 0, 0);
-        for (int s = 0; s < _samples_per_pixel; ++s) {
-            auto u = (i + random_double()) / (image_width-1);
-            auto v = ((image_height-1-j) + random_double()) / (image_height-1); // spatial convention, not image convention!
-            ray r = cam.get_ray(u, v);
-            pixel_color += _ray_color(r, background, world, tracer_constants::max_depth);
+        const int last_sample = first_sample + _samples_per_pixel;
+        int s = first_sample;
+        // camera rays of consecutive samples are traced as packets, as long as
+        // two of them are left
+        if constexpr (tracer_constants::max_depth > 0) {
+            for (; last_sample - s >= 2; s += ray_packet::size)
+                _sample_packet(i, j, pixel_index, s, std::min(ray_packet::size, last_sample - s), pixel_color);
         }
+        for (; s < last_sample; ++s)
+            pixel_color += _ray_color(_camera_ray(i, j, pixel_index, s));
         return pixel_color;
     }
 
-    int _run_single(std::uint8_t* output_image)
+    // Starts the random stream and the sample vector of the sample s of the
+    // pixel, and returns its camera ray
+    inline ray _camera_ray(int i, int j, std::uint64_t pixel_index, int s)
     {
-        int progress = 0;
+        // every sample owns a random stream and a sample vector, whichever worker computes it
+        thread_rng().seed(pixel_index, static_cast<std::uint64_t>(s), frame);
+        thread_sample_stream().start(pixel_sampler.get(), i, j, s, frame);
+        const auto [du, dv] = next_sample_2d();
+        auto u = (real(i) + du) / (image_width-1);
+        auto v = (real(image_height-1-j) + dv) / (image_height-1); // spatial convention, not image convention!
+        return cam.get_ray(u, v);
+    }
 
-        dynamic_gui dgui(image_width, image_height, 2, "Single");
+    // Camera rays of count samples of the pixel intersected as one packet, the
+    // paths then going on one after the other in sample order
+    void _sample_packet(int i, int j, std::uint64_t pixel_index, int first_sample, int count, color& pixel_color)
+    {
+        std::array<ray,ray_packet::size> rays;
+        std::array<pcg32,ray_packet::size> rngs;
+        std::array<sample_stream,ray_packet::size> streams;
+        int mask = 0;
+        for (int k = 0; k < count; ++k) {
+            const auto lane = static_cast<size_t>(k);
+            rays[lane] = _camera_ray(i, j, pixel_index, first_sample + k);
+            rngs[lane] = thread_rng();
+            streams[lane] = thread_sample_stream();
+            mask |= 1 << k;
+        }
+        // lanes past the last sample keep a copy of the first ray
+        for (int k = count; k < ray_packet::size; ++k)
+            rays[static_cast<size_t>(k)] = rays[0];
+
+        ray_packet packet(rays, mask);
+        for (int k = 0; k < count; ++k)
+            packet.streams[static_cast<size_t>(k)] = &rngs[static_cast<size_t>(k)];
+        packet_distances t_max;
+        t_max.fill(infinity);
+        packet_records recs;
+        const int hits = world.hit_packet(packet, mask, real(0.001), t_max, recs);
+
+        for (int k = 0; k < count; ++k) {
+            const auto lane = static_cast<size_t>(k);
+            thread_rng() = rngs[lane];
+            thread_sample_stream() = streams[lane];
+            pixel_color += _ray_color(rays[lane], (hits & (1 << k)) != 0, recs[lane]);
+        }
+    }
 
-        const auto start = std::chrono::steady_clock::now();
-        
-        for (int j = 0; j < image_height; ++j) {
-            progress = j*100/image_height;
-            std::cout << "Computing done @" << progress << "%\r" << std::flush;
-            int offset = color_channels*j*image_width;
-            for (int i = 0; i < image_width; ++i) {
-                write_color(output_image+offset, _stochastic_sample(i,j), tracer_constants::samples_per_pixel);
+    void _render_tile(std::uint8_t* output_image, const tile& t)
+    {
+        for (int j = t.y0; j < t.y1; ++j) {
+            int offset = color_channels*(j*image_width+t.x0);
+            for (int i = t.x0; i < t.x1; ++i) {
+                write_color(output_image+offset, _stochastic_sample(i,j), samples_per_pixel);
                 offset += color_channels;
             }
+        }
+    }
 
-            // manage dynamic progress gui
-            dgui.show(output_image);
+    // Run the tile jobs, report progress until completion and merge the path
+    // statistics gathered by each worker.
+    void _dispatch(tile_scheduler& ts, const std::vector<tile>& tiles, const tile_scheduler::tile_job& job)
+    {
+        std::vector<path_statistics> worker_statistics(ts.size());
+
+        ts.submit( tiles, [&](const tile& t, size_t worker) {
+            job(t, worker);
+            worker_statistics[worker] += std::exchange(thread_path_statistics(), {});
+        });
+
+        using namespace std::chrono_literals;
+        while(!ts.wait_for(100ms)) {
+            const auto percent = 100*ts.tiles_done()/ts.tiles_total();
+            std::cout << "Computing done @" << percent << "%\r" << std::flush;
         }
 
-        const auto end = std::chrono::steady_clock::now();
-        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-        return static_cast<int>(elapsed_ms);
+        for (const auto& ws : worker_statistics)
+            statistics += ws;
     }
 
-    bool _compute_corners_heuristic(int* upleft_corner, size_t square_length, size_t square_line_offset/*, int p, int q*/)
+    int _run_single(std::uint8_t* output_image)
     {
-        constexpr int subdivide_thresh = 100;
+        tile_scheduler ts{1};
 
-        auto rgb_tuple_accessor = [&]<typename T>(T* data,size_t i, size_t j) { 
-            
-            T* pix_start = data+i*color_channels+j*color_channels*image_width;
-            return std::tuple{  pix_start[0], 
-                                pix_start[1], 
-                                pix_start[2] };
-        };
+        gui_t dgui(image_width, image_height, 2, "Single");
 
-        const auto [cr1,cg1,cb1] = rgb_tuple_accessor(upleft_corner,0,0);
-        const auto [cr2,cg2,cb2] = rgb_tuple_accessor(upleft_corner,square_length-1,0);
-        const auto [cr3,cg3,cb3] = rgb_tuple_accessor(upleft_corner,0,square_length-1);
-        const auto [cr4,cg4,cb4] = rgb_tuple_accessor(upleft_corner,square_length-1,square_length-1);
+        const auto start = std::chrono::steady_clock::now();
 
-        const auto distance1 = (cr1 - cr2)*(cr1 - cr2) + (cg1 - cg2)*(cg1 - cg2) + (cb1 - cb2)*(cb1 - cb2);
-        if( distance1 > subdivide_thresh) return true;
-        const auto distance2 = (cr2 - cr4)*(cr2 - cr4) + (cg2 - cg4)*(cg2 - cg4) + (cb2 - cb4)*(cb2 - cb4);
-        if( distance2 > subdivide_thresh) return true;
-        const auto distance3 = (cr4 - cr3)*(cr4 - cr3) + (cg4 - cg3)*(cg4 - cg3) + (cb4 - cb3)*(cb4 - cb3);
-        if( distance3 > subdivide_thresh) return true;
-        const auto distance4 = (cr3 - cr1)*(cr3 - cr1) + (cg3 - cg1)*(cg3 - cg1) + (cb3 - cb1)*(cb3 - cb1);
-        if( distance4 > subdivide_thresh) return true;
+        _dispatch( ts, tile_scheduler::make_tiles(image_width, image_height, tracer_constants::tile_size),
+            [&](const tile& t, size_t) {
+                _render_tile(output_image, t);
 
-        /*write_color<int>(   upleft_corner+(square_length/2)*color_channels+(square_length/2)*color_channels*image_width, 
-                            _stochastic_sample(p+static_cast<int>(square_length/2),q+static_cast<int>(square_length/2)),
-                            tracer_constants::samples_per_pixel);
+                // manage dynamic progress gui
+                dgui.show(output_image);
+            });
 
-        const auto [crx,cgx,cbx] = rgb_tuple_accessor(upleft_corner,square_length/2,square_length/2);
-        const auto distancex1 = (cr1 - crx)*(cr1 - crx) + (cg1 - cgx)*(cg1 - cgx) + (cb1 - cbx)*(cb1 - cbx);
-        if( distancex1 > subdivide_thresh) return true;
-        const auto distancex2 = (cr2 - crx)*(cr2 - crx) + (cg2 - cgx)*(cg2 - cgx) + (cb2 - cbx)*(cb2 - cbx);
-        if( distancex2 > subdivide_thresh) return true;
-        const auto distancex3 = (cr3 - cr1)*(cr3 - crx) + (cg3 - cgx)*(cg3 - cgx) + (cb3 - cbx)*(cb3 - cbx);
-        if( distancex3 > subdivide_thresh) return true;
-        const auto distancex4 = (cr4 - cr3)*(cr4 - crx) + (cg4 - cgx)*(cg4 - cgx) + (cb4 - cbx)*(cb4 - cbx);
-        if( distancex4 > subdivide_thresh) return true;*/
+        const auto end = std::chrono::steady_clock::now();
+        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        return static_cast<int>(elapsed_ms);
+    }
 
-        return false;
+    // Mean linear color to the [0,256[ display scale of write_color
+    static double _to_display(float value)
+    {
+        return 256.0 * clamp(std::sqrt(static_cast<double>(value)), 0.0, 0.999);
     }
 
-    color _interpolate(int x, int y, int x1, int x2, int y1, int y2, color Q11, color Q12, color Q21, color Q22)
+    // Subdivide when two neighbouring corners of [x0,x1]x[y0,y1] differ by more
+    // than the threshold (squared distance on the display scale)
+    bool _compute_corners_heuristic(const float* work_image, int x0, int y0, int x1, int y1)
     {
-        // https://www.omnicalculator.com/math/bilinear-interpolation
+        constexpr double subdivide_thresh = 100;
+
+        const auto distance = [&](int ia, int ja, int ib, int jb) {
+            const float* a = work_image + color_channels*(ja*image_width+ia);
+            const float* b = work_image + color_channels*(jb*image_width+ib);
+            double d2 = 0.0;
+            for (int c = 0; c < 3; ++c) {
+                const auto d = _to_display(a[c]) - _to_display(b[c]);
+                d2 += d*d;
+            }
+            return d2;
+        };
+
+        return distance(x0,y0,x1,y0) > subdivide_thresh
+            || distance(x1,y0,x1,y1) > subdivide_thresh
+            || distance(x1,y1,x0,y1) > subdivide_thresh
+            || distance(x0,y1,x0,y0) > subdivide_thresh;
+    }
 
-        const auto xdiff = x2-x1;
-        const color R1 = (x2 - x)*Q11/xdiff +  (x-x1)*Q21/xdiff;
-        const color R2 = (x2 - x)*Q12/xdiff +  (x-x1)*Q22/xdiff; // TODO-AM : could be precomputed
+    // Bilinear interpolation, tx and ty in [0,1] from Q11 (x1,y1) to Q22 (x2,y2)
+    color _interpolate(double tx, double ty, color Q11, color Q12, color Q21, color Q22)
+    {
+        // https://www.omnicalculator.com/math/bilinear-interpolation
 
-        const auto ydiff = y2-y1;
-        return (y2-y)*R1/ydiff + (y-y1)*R2/ydiff;
+        const color R1 = (1-tx)*Q11 + tx*Q21;
+        const color R2 = (1-tx)*Q12 + tx*Q22;
+        return (1-ty)*R1 + ty*R2;
     }
 
     int _run_adaptive(std::uint8_t* output_image)
     {
-        std::atomic<int> progress = 0;
+        tile_scheduler ts{thread_count};
 
-        thread_pool tp{4};
+        gui_t dgui(image_width, image_height, 2, "Adaptive");
 
-        dynamic_gui dgui(image_width, image_height, 2, "Adaptive");
+        // mean linear color of each pixel, negative until sampled or interpolated
+        frame_allocator<float,frame_size,1> frame_alloc;
+        auto& work_image = frame_alloc.get_frame(0,-1.f);
 
-        const auto rgb_accessor = [&]<typename T>(T* data,int i, int j) -> T* { 
-            return data+i*color_channels+j*color_channels*image_width;
+        const auto pixel_accessor = [&](int i, int j) {
+            return work_image.data() + color_channels*(j*image_width+i);
         };
 
-        const auto to_color_func = [&]<typename T>(T* data, int i, int j) { 
-            std::ptrdiff_t offset = i*color_channels+j*color_channels*image_width;
-            return color{ 
-                static_cast<double>(data[0+offset]),
-                static_cast<double>(data[1+offset]),
-                static_cast<double>(data[2+offset])
-            };
+        const auto to_color = [&](int i, int j) {
+            const float* pixel = pixel_accessor(i,j);
+            return color(pixel[0], pixel[1], pixel[2]);
         };
 
-        frame_allocator<int,tracer_constants::frame_size,1> frame_alloc; // TODO-AM : int image really needed?
-        auto& work_image = frame_alloc.get_frame(0,-1);
+        const auto store_color = [&](int i, int j, const color& c) {
+            float* pixel = pixel_accessor(i,j);
+            pixel[0] = static_cast<float>(c.x());
+            pixel[1] = static_cast<float>(c.y());
+            pixel[2] = static_cast<float>(c.z());
+        };
 
-        using namespace std::chrono_literals;
         const auto start = std::chrono::steady_clock::now();
 
         constexpr int big_square_size = 12;
-        constexpr int mid_square_size = big_square_size/2;
-        constexpr int small_square_size = mid_square_size/2;
-        static_assert(big_square_size % 3 == 0 && big_square_size % 2 == 0); // must be even and a multiple of 3!!
-        if(image_width % big_square_size != 0 || image_height % big_square_size != 0) 
-            throw std::logic_error( "for adaptive strategy image size should perfectly fit big square size for now!!");
-
-        /* interpolate square content */
-        const auto interpolate_square = [&](int* data, int i, int j, int square_size)
+        constexpr int small_square_size = 3; // rectangles up to this size are fully sampled
+
+        /* sample a pixel, corners shared by neighbouring rectangles only once */
+        const auto sample = [&](int i, int j)
+        {
+            if(pixel_accessor(i,j)[0] >= 0)
+                return;
+            store_color(i, j, _stochastic_sample(i,j) / samples_per_pixel);
+        };
+
+        /* interpolate rectangle content from its corners */
+        const auto interpolate_rectangle = [&](int x0, int y0, int x1, int y1)
         {
-            const auto pixel_upleft = rgb_accessor(data,i,j);
-            const auto x1 = i;
-            const auto x2 = i+square_size-1;
-            const auto y1 = j;
-            const auto y2 = j+square_size-1;
-            const auto color1 = to_color_func(data,x1,y1);
-            const auto color2 = to_color_func(data,x1,y2);
-            const auto color3 = to_color_func(data,x2,y1);
-            const auto color4 = to_color_func(data,x2,y2);
-
-            for(int l=0; l<square_size; ++l)
+            const auto color1 = to_color(x0,y0);
+            const auto color2 = to_color(x0,y1);
+            const auto color3 = to_color(x1,y0);
+            const auto color4 = to_color(x1,y1);
+
+            for(int j=y0; j<=y1; ++j)
             {
-                for(int k=0; k<square_size; ++k)
+                const auto ty = y1 > y0 ? static_cast<double>(j-y0)/(y1-y0) : 0.0;
+                for(int i=x0; i<=x1; ++i)
                 {
-                    const auto pixel_interp = rgb_accessor(pixel_upleft,k,l);
-                    if(pixel_interp[0] >= 0) // don't overwrite updated pixel
+                    if(pixel_accessor(i,j)[0] >= 0) // don't overwrite updated pixel
                         continue;
 
-                    // compute interpolated colors
-                    const color interp_color = _interpolate(
-                        i+k, j+l,
-                        x1, x2, y1, y2,
-                        color1,
-                        color2,
-                        color3,
-                        color4
-                    );
-                    // write pixel
-                    write_color_raw(pixel_interp, interp_color); // NOTE: don't apply gamma correction here!
+                    const auto tx = x1 > x0 ? static_cast<double>(i-x0)/(x1-x0) : 0.0;
+                    store_color(i, j, _interpolate(tx, ty, color1, color2, color3, color4));
                 }
             }
         };
 
-        /* evaluate square corner colors */
-        const auto evaluate_corners = [&](int* data, int i, int j, int square_size)
-        {
-            const auto pixel_upleft = rgb_accessor(data,i,j);
-            const auto pixel_upright = rgb_accessor(data,i+square_size-1,j);
-            const auto pixel_bottomleft = rgb_accessor(data,i,j+square_size-1);
-            const auto pixel_bottomright = rgb_accessor(data,i+square_size-1,j+square_size-1);
-            write_color<int>(pixel_upleft, _stochastic_sample(i,j), tracer_constants::samples_per_pixel);
-            write_color<int>(pixel_upright, _stochastic_sample(i+square_size-1,j), tracer_constants::samples_per_pixel);
-            write_color<int>(pixel_bottomleft, _stochastic_sample(i,j+square_size-1), tracer_constants::samples_per_pixel);
-            write_color<int>(pixel_bottomright, _stochastic_sample(i+square_size-1,j+square_size-1), tracer_constants::samples_per_pixel);
-        };
-
-        /* whole process on the "big square" */
-        const auto process_square = [&](int i ,int j)
+        /* corners of [x0,x1]x[y0,y1] decide between interpolation and subdivision,
+           down to small squares which are fully sampled; rectangles cropped by the
+           image border are split the same way */
+        const auto process_rectangle = [&](const auto& self, int x0, int y0, int x1, int y1) -> void
         {
-            const auto pixel_upleft = rgb_accessor(work_image.data(),i,j);
-            evaluate_corners(work_image.data(),i,j,big_square_size);
+            sample(x0,y0);
+            sample(x1,y0);
+            sample(x0,y1);
+            sample(x1,y1);
 
-            // do we need smaller resolution
-            bool need_subsampling = _compute_corners_heuristic(pixel_upleft,big_square_size,image_width/*,i,j*/);
-
-            if(need_subsampling) 
+            if(!_compute_corners_heuristic(work_image.data(),x0,y0,x1,y1))
             {
-                for(int l=j; l<j+big_square_size; l+= mid_square_size) {
-                    for(int k=i; k<i+big_square_size; k+=mid_square_size) {
-
-                        const auto pixel_upleft2 = rgb_accessor(work_image.data(),k,l);
-                        evaluate_corners(work_image.data(),k,l,mid_square_size);
-
-                        // do we need smaller resolution
-                        bool need_subsampling2 = _compute_corners_heuristic(pixel_upleft2,mid_square_size,image_width/*,k,l*/);
-
-                        if(need_subsampling2)
-                        {
-                            for(int n=l; n<l+mid_square_size; n+=small_square_size) {
-                                for(int m=k; m<k+mid_square_size; m+=small_square_size) {
-
-                                    const auto pixel_upleft3 = rgb_accessor(work_image.data(),m,n);
-                                    evaluate_corners(work_image.data(),m,n,small_square_size);
-
-                                    // do we need smallest resolution -> 3px
-                                    bool need_subsampling3 = _compute_corners_heuristic(pixel_upleft3,small_square_size,image_width/*,m,n*/);
-
-                                    if(need_subsampling3) 
-                                    {
-                                        const auto pixel1 = rgb_accessor(work_image.data(),m+1,n);
-                                        const auto pixel2 = rgb_accessor(work_image.data(),m,n+1);
-                                        const auto pixel3 = rgb_accessor(work_image.data(),m+1,n+1);
-                                        const auto pixel4 = rgb_accessor(work_image.data(),m+2,n+1);
-                                        const auto pixel5 = rgb_accessor(work_image.data(),m+1,n+2);
-                                        write_color<int>(pixel1, _stochastic_sample(m+1,n), tracer_constants::samples_per_pixel);
-                                        write_color<int>(pixel2, _stochastic_sample(m,n+1), tracer_constants::samples_per_pixel);
-                                        write_color<int>(pixel3, _stochastic_sample(m+1,n+1), tracer_constants::samples_per_pixel);
-                                        write_color<int>(pixel4, _stochastic_sample(m+2,n+1), tracer_constants::samples_per_pixel);
-                                        write_color<int>(pixel5, _stochastic_sample(m+1,n+2), tracer_constants::samples_per_pixel);
-                                    }
-                                    else // interpolate smallest square
-                                    {
-                                        interpolate_square(work_image.data(),m,n,small_square_size);
-                                    }
-                                }
-                            }
-                        }
-                        else // interpolate mid square
-                        {
-                            interpolate_square(work_image.data(),k,l,mid_square_size);
-                        }
-                    }
-                }
+                interpolate_rectangle(x0,y0,x1,y1);
+                return;
             }
-            else // interpolate big square
+
+            const bool split_x = x1-x0+1 > small_square_size;
+            const bool split_y = y1-y0+1 > small_square_size;
+            if(!split_x && !split_y)
             {
-                interpolate_square(work_image.data(),i,j,big_square_size);
+                for(int j=y0; j<=y1; ++j)
+                    for(int i=x0; i<=x1; ++i)
+                        sample(i,j);
+                return;
             }
+
+            // halve the dimensions larger than a small square
+            const int xm = split_x ? x0+(x1-x0+1)/2 : x1+1;
+            const int ym = split_y ? y0+(y1-y0+1)/2 : y1+1;
+            self(self, x0, y0, xm-1, ym-1);
+            if(split_x)
+                self(self, xm, y0, x1, ym-1);
+            if(split_y)
+                self(self, x0, ym, xm-1, y1);
+            if(split_x && split_y)
+                self(self, xm, ym, x1, y1);
         };
 
-        const auto run_stripe = [&](int j0, int j1)
-        {
-            for (int j = j0; j < j1; j+=big_square_size) {
-                for (int i = 0; i < image_width; i+=big_square_size) {
+        constexpr int adaptive_tile_size = 2*big_square_size;
 
-                    // process a "big square"
-                    process_square(i,j);
+        _dispatch( ts, tile_scheduler::make_tiles(image_width, image_height, adaptive_tile_size),
+            [&](const tile& t, size_t) {
+                // "big squares" stay inside the tile, cropped on border tiles
+                for (int j = t.y0; j < t.y1; j+=big_square_size)
+                    for (int i = t.x0; i < t.x1; i+=big_square_size)
+                        process_rectangle(process_rectangle, i, j,
+                                          std::min(i+big_square_size,t.x1)-1, std::min(j+big_square_size,t.y1)-1);
 
-                    // manage dynamic progress gui
-                    dgui.show(work_image.data());
-                }
-                progress++;
-            }
-        };
-
-        constexpr int stripe_size = big_square_size*(image_height/(4*big_square_size));
-        tp.add_job( [&](){ run_stripe(0,stripe_size); } );
-        tp.add_job( [&](){ run_stripe(stripe_size,2*stripe_size); } );
-        tp.add_job( [&](){ run_stripe(2*stripe_size,3*stripe_size); } );
-        tp.add_job( [&](){ run_stripe(3*stripe_size,image_height); } );
-        while(true) {
-            const auto percent = 100*progress/(image_height/big_square_size);
-            std::cout << "Computing done @" << percent << "%\r" << std::flush;
-            std::this_thread::sleep_for(100ms);
-            if(percent >= 100)
-                break;
-        }
-        tp.wait_all();        
+                for (int j = t.y0; j < t.y1; ++j)
+                    for (int i = t.x0; i < t.x1; ++i)
+                        write_color(output_image+color_channels*(j*image_width+i), to_color(i,j), 1);
 
-        std::transform(work_image.cbegin(), work_image.cend(), output_image, 
-            [](const int& val){ return static_cast<std::uint8_t>(val); });
+                // manage dynamic progress gui
+                dgui.show(output_image);
+            });
 
         const auto end = std::chrono::steady_clock::now();
         const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -334,140 +515,632 @@ private:
 
     int _run_parallel_stripes(std::uint8_t* output_image)
     {
-        std::atomic<int> progress = 0;
+        gui_t dgui(image_width, image_height, 2, "Parallel Tiles");
 
-        dynamic_gui dgui(image_width, image_height, 2, "Parallel Stripes");
+        tile_scheduler ts{thread_count};
 
-        thread_pool tp{4};
+        const auto start = std::chrono::steady_clock::now();
 
-        auto run_stripe = [&](int j0, int j1) {
-            for (int j = j0; j < j1; ++j) {
-                int offset = color_channels*j*image_width;
-                for (int i = 0; i < image_width; ++i) {
-                    write_color(output_image+offset, _stochastic_sample(i,j), tracer_constants::samples_per_pixel);
-                    offset += color_channels;
-                }
-                progress++;
+        _dispatch( ts, tile_scheduler::make_tiles(image_width, image_height, tracer_constants::tile_size),
+            [&](const tile& t, size_t) {
+                _render_tile(output_image, t);
 
                 // manage dynamic progress gui
                 dgui.show(output_image);
-            }         
-        };
-        
-        using namespace std::chrono_literals;
-        const auto start = std::chrono::steady_clock::now();
-        
-        tp.add_job( [&](){ run_stripe(0,image_height/4); } );
-        tp.add_job( [&](){ run_stripe(image_height/4,image_height/2); } );
-        tp.add_job( [&](){ run_stripe(image_height/2,3*image_height/4); } );
-        tp.add_job( [&](){ run_stripe(3*image_height/4,image_height); } );
-        while(true) {
-            const auto percent = 100*progress/image_height;
-            std::cout << "Computing done @" << percent << "%\r" << std::flush;
-            std::this_thread::sleep_for(100ms);
-            if(percent >= 100)
-                break;
-        }
-        tp.wait_all();
+            });
 
         const auto end = std::chrono::steady_clock::now();
         const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         return static_cast<int>(elapsed_ms);
     }
 
-    int _run_parallel_images(std::uint8_t* output_image)
+    // Sample-sliced rendering: the samples of every pixel are split in one
+    // slice per worker. A slice of a tile is summed in a tile accumulator owned
+    // by the worker, then added to a shared fixed-point frame: integer sums do
+    // not depend on the order in which slices land, so the image is reproducible.
+    int _run_sample_slices(std::uint8_t* output_image)
     {
-        std::atomic<int> progress = 0;
-
-        thread_pool tp{4};
+        tile_scheduler ts{thread_count};
 
-        if constexpr (tracer_constants::progress_gui)
+        if constexpr (!std::is_base_of_v<dynamic_gui_stub, gui_t>)
         {
-            std::cout << "progress gui not available for now for parallel images mode :-(" << std::endl;
+            std::cout << "progress gui not available for now for sample slices mode :-(" << std::endl;
+        }
+
+        constexpr int tile_size = tracer_constants::tile_size;
+        constexpr double fixed_point_scale = 16777216.0; // 2^24
+        // Slice sums are clamped to 2^32 (fireflies and infinities included),
+        // i.e. at most 2^56 in fixed point: 255 slices add up to less than
+        // 2^64, 256 clamped slices would wrap the 64 bit accumulators to 0.
+        constexpr double max_slice_value = 4294967296.0; // 2^32
+        constexpr int max_slices = 255;
+        static_assert(max_slices * max_slice_value * fixed_point_scale < 18446744073709551616.0); // 2^64
+        const int slice_count = std::clamp(static_cast<int>(ts.size()), 1, std::clamp(samples_per_pixel, 1, max_slices));
+
+        frame_allocator<std::uint64_t,frame_size,1> frame_alloc;
+        auto& accumulation = frame_alloc.get_frame(0,0);
+        std::vector<std::vector<color>> tile_accumulators(ts.size(), std::vector<color>(tile_size*tile_size));
+
+        // tiles of the slices are stacked vertically in a single batch so that
+        // the workers start on different slices
+        const auto image_tiles = tile_scheduler::make_tiles(image_width, image_height, tile_size);
+        std::vector<tile> tiles;
+        for (int k = 0; k < slice_count; ++k) {
+            for (auto t : image_tiles) {
+                t.y0 += k*image_height;
+                t.y1 += k*image_height;
+                tiles.push_back(t);
+            }
         }
 
-        frame_allocator<float,tracer_constants::frame_size,4> frame_alloc;
-        auto& work_image1 = frame_alloc.get_frame(0,0.f);
-        auto& work_image2 = frame_alloc.get_frame(1,0.f);
-        auto& work_image3 = frame_alloc.get_frame(2,0.f);
-        auto& work_image4 = frame_alloc.get_frame(3,0.f);
-
-        auto run_image = [&](float* partial_image,int small_samples_per_pixel) {
-            for (int j = 0; j < image_height; ++j) {
-                int offset = color_channels*j*image_width;
-                for (int i = 0; i < image_width; ++i) {
-                    const color pixel_color = _stochastic_sample(i,j,small_samples_per_pixel);
-                    auto* out = partial_image+offset;
-                    write_color_raw<float>(out,pixel_color); // NOTE: don't apply gamma correction here!
+        const auto start = std::chrono::steady_clock::now();
+
+        _dispatch( ts, tiles, [&](const tile& t, size_t worker) {
+            const int k = t.y0 / image_height;
+            const int first_sample = k*samples_per_pixel/slice_count;
+            const int slice_samples = (k+1)*samples_per_pixel/slice_count - first_sample;
+            const int y0 = t.y0 - k*image_height;
+            const int y1 = t.y1 - k*image_height;
+
+            auto& tile_accumulator = tile_accumulators[worker];
+            for (int j = y0; j < y1; ++j)
+                for (int i = t.x0; i < t.x1; ++i)
+                    tile_accumulator[static_cast<size_t>((j-y0)*tile_size + i-t.x0)] = _stochastic_sample(i,j,slice_samples,first_sample);
+
+            for (int j = y0; j < y1; ++j) {
+                auto offset = static_cast<size_t>(color_channels*(j*image_width+t.x0));
+                for (int i = t.x0; i < t.x1; ++i) {
+                    const auto& pixel_color = tile_accumulator[static_cast<size_t>((j-y0)*tile_size + i-t.x0)];
+                    for (int c = 0; c < 3; ++c) {
+                        // NaN and negative sums are dropped, +inf takes the ceiling
+                        const double slice_value = pixel_color[c];
+                        const double clamped = std::isfinite(slice_value) ? std::clamp(slice_value, 0.0, max_slice_value)
+                                                                          : (slice_value > 0.0 ? max_slice_value : 0.0);
+                        const auto value = static_cast<std::uint64_t>(clamped * fixed_point_scale + 0.5);
+                        std::atomic_ref<std::uint64_t>(accumulation[offset+static_cast<size_t>(c)]).fetch_add(value, std::memory_order_relaxed);
+                    }
                     offset += color_channels;
                 }
-                progress++;
             }
-        };
+        });
+
+        // the slices are already summed, only the conversion is left, in parallel
+        scoped_trace resolve_trace("resolve accumulation");
+        _dispatch( ts, image_tiles, [&](const tile& t, size_t) {
+            for (int j = t.y0; j < t.y1; ++j) {
+                auto offset = static_cast<size_t>(color_channels*(j*image_width+t.x0));
+                for (int i = t.x0; i < t.x1; ++i) {
+                    const color pixel_color(
+                        static_cast<double>(accumulation[offset]) / fixed_point_scale,
+                        static_cast<double>(accumulation[offset+1]) / fixed_point_scale,
+                        static_cast<double>(accumulation[offset+2]) / fixed_point_scale);
+                    write_color(output_image+offset, pixel_color, samples_per_pixel);
+                    offset += color_channels;
+                }
+            }
+        });
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        return static_cast<int>(elapsed_ms);
+    }
+
+    // Passes of progressive_pass_samples over the whole image, each one published,
+    // until samples_per_pixel or the time budget is reached
+    int _run_progressive(std::uint8_t* output_image)
+    {
+        tile_scheduler ts{thread_count};
+
+        gui_t dgui(image_width, image_height, 2, "Progressive");
+
+        // running sums of the samples, the output holds the current estimate
+        frame_allocator<float,frame_size,1> frame_alloc;
+        auto& accumulation = frame_alloc.get_frame(0,0.f);
+        const auto tiles = tile_scheduler::make_tiles(image_width, image_height, tracer_constants::tile_size);
 
-        using namespace std::chrono_literals;
         const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + time_budget;
+
+        int samples_done = 0;
+        while (samples_done < samples_per_pixel) {
+            const auto pass_start = std::chrono::steady_clock::now();
+            const int pass_samples = std::min(tracer_constants::progressive_pass_samples, samples_per_pixel - samples_done);
+            const int total_samples = samples_done + pass_samples;
+
+            scoped_trace pass_trace("progressive pass");
+            _dispatch( ts, tiles, [&](const tile& t, size_t) {
+                for (int j = t.y0; j < t.y1; ++j) {
+                    int offset = color_channels*(j*image_width+t.x0);
+                    for (int i = t.x0; i < t.x1; ++i) {
+                        // samples keep their index, and thus their random stream, across passes
+                        const color pass_color = _stochastic_sample(i, j, pass_samples, samples_done);
+                        float* acc = accumulation.data()+offset;
+                        acc[0] += static_cast<float>(pass_color.x());
+                        acc[1] += static_cast<float>(pass_color.y());
+                        acc[2] += static_cast<float>(pass_color.z());
+                        write_color(output_image+offset, color(acc[0], acc[1], acc[2]), total_samples);
+                        offset += color_channels;
+                    }
+                }
+            });
+            samples_done = total_samples;
 
-        tp.add_job( [&](){ run_image(work_image1.data(), tracer_constants::samples_per_pixel/4); } );
-        tp.add_job( [&](){ run_image(work_image2.data(), tracer_constants::samples_per_pixel/4); } );
-        tp.add_job( [&](){ run_image(work_image3.data(), tracer_constants::samples_per_pixel/4); } );
-        tp.add_job( [&](){ run_image(work_image4.data(), tracer_constants::samples_per_pixel/4); } );
-        while(true) {
-            const auto percent = 100*progress/(4*image_height);
-            std::cout << "Computing done @" << percent << "%\r" << std::flush;
-            std::this_thread::sleep_for(100ms);
-            if(percent >= 100)
+            dgui.show(output_image);
+            if (pass_callback)
+                pass_callback(output_image, samples_done);
+
+            // stop when the next pass, expected as long as this one, would miss the deadline
+            const auto now = std::chrono::steady_clock::now();
+            if (time_budget.count() > 0 && now + (now - pass_start) > deadline)
                 break;
         }
-        tp.wait_all();
-
-        for (int j = 0; j < image_height; ++j) {
-            int offset = color_channels*j*image_width;
-            for (int i = 0; i < image_width; ++i) {
-                auto* wk1 = work_image1.data()+offset;
-                auto* wk2 = work_image2.data()+offset;
-                auto* wk3 = work_image3.data()+offset;
-                auto* wk4 = work_image4.data()+offset;
-                color pixel_color1(wk1[0], wk1[1], wk1[2]);
-                color pixel_color2(wk2[0], wk2[1], wk2[2]);
-                color pixel_color3(wk3[0], wk3[1], wk3[2]);
-                color pixel_color4(wk4[0], wk4[1], wk4[2]);
-                color pixel_acc = pixel_color1+pixel_color2+pixel_color3+pixel_color4;
-                auto* out = output_image+offset;
-                write_color(out, pixel_acc, tracer_constants::samples_per_pixel);
-                offset += color_channels;
+        rendered_samples = samples_done;
+        std::cout << "progressive rendering stopped after " << samples_done << " samples per pixel" << std::endl;
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        return static_cast<int>(elapsed_ms);
+    }
+
+    int _run_variance_adaptive(std::uint8_t* output_image)
+    {
+        tile_scheduler ts{thread_count};
+
+        gui_t dgui(image_width, image_height, 2, "Variance Adaptive");
+
+        // running color sum, and mean and variance (Welford) of the luminance
+        struct pixel_estimate
+        {
+            float r = 0.f, g = 0.f, b = 0.f;
+            double mean = 0.0;
+            double m2 = 0.0;
+            int samples = 0;
+
+            void add(const color& c)
+            {
+                r += static_cast<float>(c.x());
+                g += static_cast<float>(c.y());
+                b += static_cast<float>(c.z());
+                const double luminance = 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+                ++samples;
+                const double delta = luminance - mean;
+                mean += delta / samples;
+                m2 += delta * (luminance - mean);
             }
+
+            // standard error of the mean, taken to display space (gamma 2)
+            // where sqrt(x) moves by dx / (2 sqrt(x))
+            double display_error() const
+            {
+                if (samples < 2)
+                    return infinity;
+                const double standard_error = std::sqrt(m2 / (samples - 1) / samples);
+                return standard_error / (2.0 * std::sqrt(std::max(mean, 1.0/256.0)));
+            }
+        };
+
+        std::vector<pixel_estimate> estimates(static_cast<size_t>(image_width*image_height));
+        std::vector<char> converged(estimates.size(), 0);
+
+        // errors of the previous pass and of the current one, swapped every
+        // pass: a tile reads the neighbours of its border pixels in other
+        // tiles while these are sampled
+        std::array<std::vector<double>,2> errors{ std::vector<double>(estimates.size()), std::vector<double>(estimates.size()) };
+
+        constexpr int tile_size = tracer_constants::tile_size;
+        constexpr int tile_columns = (image_width + tile_size - 1) / tile_size;
+        constexpr int tile_rows = (image_height + tile_size - 1) / tile_size;
+
+        // tiles still holding unconverged pixels, flagged on the tile grid
+        auto tiles = tile_scheduler::make_tiles(image_width, image_height, tile_size);
+        std::vector<char> tile_active(static_cast<size_t>(tile_columns*tile_rows));
+
+        const int min_samples = std::min(tracer_constants::adaptive_min_samples, samples_per_pixel);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int pass = 0; !tiles.empty(); ++pass) {
+            const auto& previous_errors = errors[static_cast<size_t>((pass+1) % 2)];
+            auto& pass_errors = errors[static_cast<size_t>(pass % 2)];
+
+            scoped_trace pass_trace("variance adaptive pass");
+            _dispatch( ts, tiles, [&](const tile& t, size_t) {
+                bool active = false;
+                for (int j = t.y0; j < t.y1; ++j) {
+                    for (int i = t.x0; i < t.x1; ++i) {
+                        const auto pixel_index = static_cast<size_t>(j*image_width+i);
+                        auto& e = estimates[pixel_index];
+
+                        // A pixel converges once its whole neighbourhood met the
+                        // target at the previous pass: a pixel whose first samples
+                        // all missed a small light reports no variance, but its
+                        // noisy neighbours keep it sampled.
+                        if (pass > 0 && !converged[pixel_index]) {
+                            double error = 0.0;
+                            for (int y = std::max(j-1, 0); y <= std::min(j+1, image_height-1); ++y)
+                                for (int x = std::max(i-1, 0); x <= std::min(i+1, image_width-1); ++x)
+                                    error = std::max(error, previous_errors[static_cast<size_t>(y*image_width+x)]);
+
+                            converged[pixel_index] = e.samples >= samples_per_pixel
+                                || (e.samples >= min_samples && error <= tracer_constants::adaptive_error_threshold);
+                        }
+                        if (converged[pixel_index]) {
+                            pass_errors[pixel_index] = previous_errors[pixel_index];
+                            continue;
+                        }
+                        active = true;
+
+                        // the first pass brings every pixel to the minimum sample count
+                        const int pass_samples = std::min(e.samples == 0 ? min_samples : tracer_constants::adaptive_pass_samples,
+                                                          samples_per_pixel - e.samples);
+                        for (int s = 0; s < pass_samples; ++s)
+                            e.add(_stochastic_sample(i, j, 1, e.samples));
+
+                        write_color(output_image+color_channels*pixel_index, color(e.r, e.g, e.b), e.samples);
+                        pass_errors[pixel_index] = e.display_error();
+                    }
+                }
+                // a converged tile leaves both error buffers holding its final errors
+                tile_active[static_cast<size_t>((t.y0/tile_size)*tile_columns + t.x0/tile_size)] = active;
+
+                // manage dynamic progress gui
+                dgui.show(output_image);
+            });
+
+            std::erase_if(tiles, [&](const tile& t) {
+                return !tile_active[static_cast<size_t>((t.y0/tile_size)*tile_columns + t.x0/tile_size)];
+            });
         }
 
+        std::uint64_t total_samples = 0;
+        for (const auto& e : estimates)
+            total_samples += static_cast<std::uint64_t>(e.samples);
+        const auto mean_samples = static_cast<double>(total_samples) / static_cast<double>(estimates.size());
+        rendered_samples = static_cast<int>(std::lround(mean_samples));
+        std::cout << "variance adaptive sampling used " << mean_samples << " samples per pixel on average" << std::endl;
+
         const auto end = std::chrono::steady_clock::now();
         const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         return static_cast<int>(elapsed_ms);
     }
 
-    color _ray_color(const ray& r, const color& background, const hittable& world, int depth) {
-        hit_record rec;
-        
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
-            return color(0,0,0);
-        
-        // If the ray hits nothing, return the background color.
-        if (!world.hit(r, 0.001, infinity, rec))
-            return background;
-        
+    // Path of the wavefront mode. It carries its random and sample streams
+    // between the stages so that it draws the same numbers as with _ray_color.
+    struct wavefront_path
+    {
+        ray             r;
+        color           throughput;
+        color           radiance;
+        hit_record      rec;
+        pcg32           rng;
+        sample_stream   samples;
+        std::uint64_t   pixel_index;    // image pixel, for the cost map
+        std::uint32_t   tile_pixel;     // pixel in the tile
+        int             depth;
+    };
+
+    // Per worker queues, reused from one tile to the next
+    struct wavefront_queues
+    {
+        std::vector<wavefront_path> paths;
+        std::vector<std::uint32_t> active;     // paths to intersect at this bounce
+        std::vector<std::uint32_t> next;       // paths scattered into the next bounce
+        std::array<std::vector<std::uint32_t>,static_cast<size_t>(material_kind::count)> shading;
+        std::vector<color> pixel_colors;
+    };
+
+    // Wavefront path tracing: the camera rays of a tile are generated as a
+    // batch, intersected as a stream, the hits are shaded grouped by material
+    // kind and the scattered rays form the queue of the next bounce.
+    int _run_wavefront(std::uint8_t* output_image)
+    {
+        tile_scheduler ts{thread_count};
+
+        gui_t dgui(image_width, image_height, 2, "Wavefront");
+
+        std::vector<wavefront_queues> worker_queues(ts.size());
+
+        const auto start = std::chrono::steady_clock::now();
+
+        _dispatch( ts, tile_scheduler::make_tiles(image_width, image_height, tracer_constants::tile_size),
+            [&](const tile& t, size_t worker) {
+                _render_tile_wavefront(output_image, t, worker_queues[worker]);
+
+                // manage dynamic progress gui
+                dgui.show(output_image);
+            });
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        return static_cast<int>(elapsed_ms);
+    }
+
+    void _render_tile_wavefront(std::uint8_t* output_image, const tile& t, wavefront_queues& q)
+    {
+        const sample_stream_scope samples;
+        auto& path_stats = thread_path_statistics();
+
+        // waves hold whole samples of every pixel, at most wavefront_size paths when possible
+        const int tile_pixels = t.width()*t.height();
+        const int wave_samples = std::max(1, tracer_constants::wavefront_size / tile_pixels);
+
+        q.pixel_colors.assign(static_cast<size_t>(tile_pixels), color(0,0,0));
+
+        for (int first_sample = 0; first_sample < samples_per_pixel; first_sample += wave_samples) {
+            const int last_sample = std::min(first_sample + wave_samples, samples_per_pixel);
+
+            // camera rays, seeded as in _sample_pixel
+            q.paths.clear();
+            q.active.clear();
+            for (int p = 0; p < tile_pixels; ++p) {
+                const int i = t.x0 + p % t.width();
+                const int j = t.y0 + p / t.width();
+                const auto pixel_index = static_cast<std::uint64_t>(j)*image_width + static_cast<std::uint64_t>(i);
+                for (int s = first_sample; s < last_sample; ++s) {
+                    wavefront_path path;
+                    path.r = _camera_ray(i, j, pixel_index, s);
+                    path.throughput = color(1,1,1);
+                    path.radiance = color(0,0,0);
+                    path.rng = thread_rng();
+                    path.samples = thread_sample_stream();
+                    path.pixel_index = pixel_index;
+                    path.tile_pixel = static_cast<std::uint32_t>(p);
+                    path.depth = 0;
+                    q.active.push_back(static_cast<std::uint32_t>(q.paths.size()));
+                    q.paths.push_back(path);
+                }
+            }
+            path_stats.paths += q.paths.size();
+
+            const auto intersected = [&](std::uint32_t id, bool hit) {
+                auto& path = q.paths[id];
+                if (!hit) {
+                    path.radiance += path.throughput * background;
+                    ++path_stats.escaped;
+                    return;
+                }
+                q.shading[static_cast<size_t>(path.rec.mat_ptr->kind)].push_back(id);
+            };
+
+            // camera rays are traced as packets, unless their cost is recorded per pixel
+            bool camera_rays = tracer_constants::max_depth > 0 && metric == cost_metric::none;
+
+            while (!q.active.empty()) {
+                // intersection stage, over the whole queue
+                for (auto& bucket : q.shading)
+                    bucket.clear();
+                if (camera_rays) {
+                    _intersect_camera_packets(t, last_sample - first_sample, q, intersected);
+                    camera_rays = false;
+                }
+                else {
+                    for (const auto id : q.active) {
+                        auto& path = q.paths[id];
+                        // camera rays only, the shading stage stops scattered rays
+                        if (path.depth >= tracer_constants::max_depth) {
+                            ++path_stats.depth_limit;
+                            continue;
+                        }
+
+                        thread_rng() = path.rng;
+                        const bool hit = _with_cost(path.pixel_index, [&] {
+                            return world.hit(path.r, real(0.001), infinity, path.rec);
+                        });
+                        path.rng = thread_rng();
+                        intersected(id, hit);
+                    }
+                }
+
+                // shading stage, one material kind after the other
+                q.next.clear();
+                for (const auto& bucket : q.shading) {
+                    for (const auto id : bucket) {
+                        auto& path = q.paths[id];
+                        const bool scattered = _with_cost(path.pixel_index, [&] {
+                            return _shade_wavefront(path, path_stats);
+                        });
+                        if (scattered)
+                            q.next.push_back(id);
+                    }
+                }
+                std::swap(q.active, q.next);
+            }
+
+            // samples are summed in order, the image matches the other modes
+            for (const auto& path : q.paths)
+                q.pixel_colors[path.tile_pixel] += path.radiance;
+        }
+
+        for (int p = 0; p < tile_pixels; ++p) {
+            const int i = t.x0 + p % t.width();
+            const int j = t.y0 + p / t.width();
+            write_color(output_image+color_channels*(j*image_width+i), q.pixel_colors[static_cast<size_t>(p)], samples_per_pixel);
+        }
+    }
+
+    // Camera rays of a wave in packets of 2x2 pixels at the same sample,
+    // paths being stored pixel after pixel, wave_samples per pixel
+    template<typename intersected_t>
+    void _intersect_camera_packets(const tile& t, int wave_samples, wavefront_queues& q, intersected_t&& intersected)
+    {
+        const auto path_id = [&](int x, int y, int s) {
+            return static_cast<std::uint32_t>((y*t.width() + x)*wave_samples + s);
+        };
+
+        for (int y = 0; y < t.height(); y += 2) {
+            for (int x = 0; x < t.width(); x += 2) {
+                for (int s = 0; s < wave_samples; ++s) {
+                    // lanes past the tile border keep a copy of the first ray
+                    std::array<std::uint32_t,ray_packet::size> ids;
+                    std::array<ray,ray_packet::size> rays;
+                    rays.fill(q.paths[path_id(x, y, s)].r);
+                    int mask = 0;
+                    for (int k = 0; k < ray_packet::size; ++k) {
+                        const int px = x + (k & 1);
+                        const int py = y + (k >> 1);
+                        if (px >= t.width() || py >= t.height())
+                            continue;
+                        const auto lane = static_cast<size_t>(k);
+                        ids[lane] = path_id(px, py, s);
+                        rays[lane] = q.paths[ids[lane]].r;
+                        mask |= 1 << k;
+                    }
+
+                    ray_packet packet(rays, mask);
+                    packet_distances t_max;
+                    t_max.fill(infinity);
+                    packet_records recs;
+                    for (int k = 0; k < ray_packet::size; ++k)
+                        if (mask & (1 << k))
+                            packet.streams[static_cast<size_t>(k)] = &q.paths[ids[static_cast<size_t>(k)]].rng;
+
+                    const int hits = world.hit_packet(packet, mask, real(0.001), t_max, recs);
+
+                    for (int k = 0; k < ray_packet::size; ++k) {
+                        if (!(mask & (1 << k)))
+                            continue;
+                        const auto lane = static_cast<size_t>(k);
+                        const bool hit = hits & (1 << k);
+                        if (hit)
+                            q.paths[ids[lane]].rec = recs[lane];
+                        intersected(ids[lane], hit);
+                    }
+                }
+            }
+        }
+    }
+
+    // One bounce of _ray_color on a hit: emission, scattering and russian
+    // roulette. Returns false when the path is terminated.
+    bool _shade_wavefront(wavefront_path& path, path_statistics& path_stats)
+    {
+        const auto& rec = path.rec;
+        path.radiance += path.throughput * rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+
+        thread_rng() = path.rng;
+        auto& samples = thread_sample_stream();
+        samples = path.samples;
+        samples.dimension = sample_dimensions::bounce(path.depth);
+
         ray scattered;
         color attenuation;
-        color emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-        
-        if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return emitted;
-        
-        return emitted + attenuation * _ray_color(scattered, background, world, depth-1);
+        bool alive = rec.mat_ptr->scatter(path.r, rec, attenuation, scattered);
+        if (!alive) {
+            ++path_stats.absorbed;
+        } else {
+            path.throughput = path.throughput * attenuation;
+
+            if (path.depth+1 >= tracer_constants::roulette_depth) {
+                const auto survival = std::min(std::max({path.throughput.x(), path.throughput.y(), path.throughput.z()}), real(0.95));
+                if (random_real() >= survival) {
+                    ++path_stats.roulette;
+                    alive = false;
+                } else {
+                    path.throughput /= survival;
+                }
+            }
+
+            // as in _ray_color, only the scattered rays traced next are counted
+            if (alive && path.depth+1 >= tracer_constants::max_depth) {
+                ++path_stats.depth_limit;
+                alive = false;
+            } else if (alive) {
+                ++path_stats.bounces;
+            }
+        }
+
+        path.rng = thread_rng();
+        path.r = scattered;
+        ++path.depth;
+        return alive;
+    }
+
+    color _ray_color(ray r) {
+        hit_record rec;
+        const bool hit = tracer_constants::max_depth > 0 && world.hit(r, real(0.001), infinity, rec);
+        return _ray_color(r, hit, rec);
+    }
+
+    // Iterative path integrator: the path throughput is carried along the
+    // bounces and low contribution paths are terminated by russian roulette.
+    // The camera ray r is intersected by the caller, hit telling if rec holds
+    // its closest hit.
+    color _ray_color(ray r, bool hit, hit_record& rec) {
+        auto& path_stats = thread_path_statistics();
+        color radiance(0,0,0);
+        color throughput(1,1,1);
+
+        ++path_stats.paths;
+
+        for (int depth = 0; ; ++depth) {
+            // If we've exceeded the ray bounce limit, no more light is gathered
+            // (scattered rays are stopped below, this only catches camera rays).
+            if (depth >= tracer_constants::max_depth) {
+                ++path_stats.depth_limit;
+                break;
+            }
+
+            if (depth > 0)
+                hit = world.hit(r, real(0.001), infinity, rec);
+
+            // If the ray hits nothing, return the background color.
+            if (!hit) {
+                radiance += throughput * background;
+                ++path_stats.escaped;
+                break;
+            }
+
+            ray scattered;
+            color attenuation;
+            radiance += throughput * rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+
+            // every bounce starts at its own dimensions, whatever the materials drew before
+            thread_sample_stream().dimension = sample_dimensions::bounce(depth);
+            if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+                ++path_stats.absorbed;
+                break;
+            }
+
+            throughput = throughput * attenuation;
+
+            // Russian roulette: survival probability follows the throughput,
+            // surviving paths being reweighted to keep the estimate unbiased.
+            if (depth+1 >= tracer_constants::roulette_depth) {
+                const auto survival = std::min(std::max({throughput.x(), throughput.y(), throughput.z()}), real(0.95));
+                if (random_real() >= survival) {
+                    ++path_stats.roulette;
+                    break;
+                }
+                throughput /= survival;
+            }
+
+            // the scattered ray is a secondary ray only if it is traced
+            if (depth+1 >= tracer_constants::max_depth) {
+                ++path_stats.depth_limit;
+                break;
+            }
+
+            ++path_stats.bounces;
+            r = scattered;
+        }
+
+        return radiance;
     }
     
 private:
     engine_mode m = engine_mode::single;
     const camera& cam;
+    size_t thread_count = tracer_constants::thread_count;
+    std::uint64_t frame = 0;
+    int samples_per_pixel = tracer_constants::samples_per_pixel;
+    sampler_kind sampling = sampler_kind::sobol;
+    std::unique_ptr<sampler> pixel_sampler = sampler::make(sampling, samples_per_pixel);
+    std::chrono::milliseconds time_budget{0};
+    std::function<void(const std::uint8_t*, int)> pass_callback;
+    int rendered_samples = 0;
+    cost_metric metric = cost_metric::none;
+    std::vector<float> pixel_cost;
+    path_statistics statistics;
     hittable_list world;
     color background{0,0,0};
 };
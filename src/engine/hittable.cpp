@@ -1,6 +1,25 @@
 #include "hittable.h"
 
-bool translate::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+#include <algorithm>
+#include <bit>
+
+int hittable::hit_packet(const ray_packet& packet, int mask, real t_min,
+                         packet_distances& t_max, packet_records& rec) const {
+    int hits = 0;
+    hit_record temp_rec;
+    for (auto lanes = static_cast<unsigned>(mask); lanes != 0; lanes &= lanes - 1) {
+        const auto k = std::countr_zero(lanes);
+        const auto lane = static_cast<size_t>(k);
+        if (hit(packet.rays[lane], t_min, t_max[lane], temp_rec)) {
+            rec[lane] = temp_rec;
+            t_max[lane] = temp_rec.t;
+            hits |= 1 << k;
+        }
+    }
+    return hits;
+}
+
+bool translate::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     ray moved_r(r.origin() - offset, r.direction(), r.time());
     if (!ptr->hit(moved_r, t_min, t_max, rec))
         return false;
@@ -11,7 +30,29 @@ bool translate::hit(const ray& r, double t_min, double t_max, hit_record& rec) c
     return true;
 }
 
-bool translate::bounding_box(double time0, double time1, aabb& output_box) const {
+translate::translate(std::shared_ptr<hittable> p, const vec3& displacement)
+    : ptr(p), offset(displacement) {
+    hasbox = bounding_box(0, 1, bbox);
+}
+
+int translate::hit_packet(const ray_packet& packet, int mask, real t_min,
+                          packet_distances& t_max, packet_records& rec) const {
+    // packets passing by are rejected before being moved
+    if (hasbox && !packet.frustum_hit(bbox.min(), bbox.max(), t_min, *std::max_element(t_max.begin(), t_max.end())))
+        return 0;
+
+    const auto moved = packet.translated(-offset);
+
+    const int hits = ptr->hit_packet(moved, mask, t_min, t_max, rec);
+    for (auto lanes = static_cast<unsigned>(hits); lanes != 0; lanes &= lanes - 1) {
+        const auto lane = static_cast<size_t>(std::countr_zero(lanes));
+        rec[lane].p += offset;
+        rec[lane].set_face_normal(moved.rays[lane], rec[lane].normal);
+    }
+    return hits;
+}
+
+bool translate::bounding_box(real time0, real time1, aabb& output_box) const {
     if (!ptr->bounding_box(time0, time1, output_box))
         return false;
 
@@ -22,10 +63,10 @@ bool translate::bounding_box(double time0, double time1, aabb& output_box) const
     return true;
 }
 
-rotate_y::rotate_y(std::shared_ptr<hittable> p, double angle) : ptr(p) {
+rotate_y::rotate_y(std::shared_ptr<hittable> p, real angle) : ptr(p) {
     auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
+    sin_theta = std::sin(radians);
+    cos_theta = std::cos(radians);
     hasbox = ptr->bounding_box(0, 1, bbox);
 
     point3 min( infinity,  infinity,  infinity);
@@ -34,9 +75,9 @@ rotate_y::rotate_y(std::shared_ptr<hittable> p, double angle) : ptr(p) {
     for (int i = 0; i < 2; i++) {
         for (int j = 0; j < 2; j++) {
             for (int k = 0; k < 2; k++) {
-                auto x = i*bbox.max().x() + (1-i)*bbox.min().x();
-                auto y = j*bbox.max().y() + (1-j)*bbox.min().y();
-                auto z = k*bbox.max().z() + (1-k)*bbox.min().z();
+                auto x = real(i)*bbox.max().x() + real(1-i)*bbox.min().x();
+                auto y = real(j)*bbox.max().y() + real(1-j)*bbox.min().y();
+                auto z = real(k)*bbox.max().z() + real(1-k)*bbox.min().z();
 
                 auto newx =  cos_theta*x + sin_theta*z;
                 auto newz = -sin_theta*x + cos_theta*z;
@@ -44,8 +85,8 @@ rotate_y::rotate_y(std::shared_ptr<hittable> p, double angle) : ptr(p) {
                 vec3 tester(newx, y, newz);
 
                 for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], tester[c]);
-                    max[c] = fmax(max[c], tester[c]);
+                    min[c] = std::fmin(min[c], tester[c]);
+                    max[c] = std::fmax(max[c], tester[c]);
                 }
             }
         }
@@ -54,7 +95,7 @@ rotate_y::rotate_y(std::shared_ptr<hittable> p, double angle) : ptr(p) {
     bbox = aabb(min, max);
 }
 
-bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+ray rotate_y::_rotated(const ray& r) const {
     auto origin = r.origin();
     auto direction = r.direction();
 
@@ -64,11 +105,10 @@ bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) co
     direction[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
     direction[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
 
-    ray rotated_r(origin, direction, r.time());
-
-    if (!ptr->hit(rotated_r, t_min, t_max, rec))
-        return false;
+    return ray(origin, direction, r.time());
+}
 
+void rotate_y::_rotate_back(const ray& rotated_r, hit_record& rec) const {
     auto p = rec.p;
     auto normal = rec.normal;
 
@@ -80,6 +120,34 @@ bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) co
 
     rec.p = p;
     rec.set_face_normal(rotated_r, normal);
+}
+
+bool rotate_y::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+    const ray rotated_r = _rotated(r);
+
+    if (!ptr->hit(rotated_r, t_min, t_max, rec))
+        return false;
 
+    _rotate_back(rotated_r, rec);
     return true;
 }
+
+int rotate_y::hit_packet(const ray_packet& packet, int mask, real t_min,
+                         packet_distances& t_max, packet_records& rec) const {
+    if (hasbox && !packet.frustum_hit(bbox.min(), bbox.max(), t_min, *std::max_element(t_max.begin(), t_max.end())))
+        return 0;
+
+    auto rotated_rays = packet.rays;
+    for (auto& r : rotated_rays)
+        r = _rotated(r);
+
+    ray_packet rotated(rotated_rays, mask);
+    rotated.streams = packet.streams;
+
+    const int hits = ptr->hit_packet(rotated, mask, t_min, t_max, rec);
+    for (auto lanes = static_cast<unsigned>(hits); lanes != 0; lanes &= lanes - 1) {
+        const auto lane = static_cast<size_t>(std::countr_zero(lanes));
+        _rotate_back(rotated.rays[lane], rec[lane]);
+    }
+    return hits;
+}
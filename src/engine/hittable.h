@@ -2,63 +2,125 @@
 #define HITTABLE_H
 
 #include "aabb.h"
+#include "ray_packet.h"
 #include "tracer_utils.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
 class material;
 
-struct hit_record {
-    point3 p;
-    vec3 normal;
-    std::shared_ptr<material> mat_ptr;
-    double t;
-    double u;
-    double v;
+template<typename T>
+struct hit_record_t {
+    vec3_t<T> p;
+    vec3_t<T> normal;
+    const material* mat_ptr = nullptr;  // non-owning, materials are owned by the primitives
+    T t;
+    T u;
+    T v;
     bool front_face;
     
-    inline void set_face_normal(const ray& r, const vec3& outward_normal)
+    inline void set_face_normal(const ray_t<T>& r, const vec3_t<T>& outward_normal)
     {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal :-outward_normal;
     }
+
+    // Origin of a ray leaving the hit point along direction: p is moved off
+    // the surface, on the side of direction, by a bound of its rounding error
+    // so that the ray cannot hit the surface again from the wrong side.
+    inline vec3_t<T> spawn_origin(const vec3_t<T>& direction) const
+    {
+        const auto magnitude = std::max({std::fabs(p.x()), std::fabs(p.y()), std::fabs(p.z())});
+        const auto offset = spawn_ulps*std::numeric_limits<T>::epsilon()*magnitude;
+        return dot(direction, normal) > 0 ? p + offset*normal : p - offset*normal;
+    }
+
+    static constexpr T spawn_ulps = 16;
 };
 
+using hit_record = hit_record_t<real>;
+
+// per lane closest distances and hit records of a packet query
+using packet_distances = std::array<real,ray_packet::size>;
+using packet_records = std::array<hit_record,ray_packet::size>;
+
 class hittable {
     public:
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const = 0;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const = 0;
+
+        // Closest hits of the packet lanes in mask: t_max[k] and rec[k] are only
+        // updated for the lanes hit closer than t_max[k], whose mask is returned.
+        // The default traces the lanes one after the other. Hittables drawing
+        // random numbers while intersecting draw from packet.streams.
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const;
 };
 
+// Lanes of mask tested one after the other with the scalar test of
+// hittable_t, without virtual calls nor copies: for the hittables writing the
+// record only when they are hit.
+template<typename hittable_t>
+int hit_lanes(const hittable_t& object, const ray_packet& packet, int mask, real t_min,
+              packet_distances& t_max, packet_records& rec) {
+    int hits = 0;
+    for (auto lanes = static_cast<unsigned>(mask); lanes != 0; lanes &= lanes - 1) {
+        const auto k = std::countr_zero(lanes);
+        const auto lane = static_cast<size_t>(k);
+        if (object.hittable_t::hit(packet.rays[lane], t_min, t_max[lane], rec[lane])) {
+            t_max[lane] = rec[lane].t;
+            hits |= 1 << k;
+        }
+    }
+    return hits;
+}
+
 class translate final : public hittable {
     public:
-        translate(std::shared_ptr<hittable> p, const vec3& displacement)
-            : ptr(p), offset(displacement) {}
+        translate(std::shared_ptr<hittable> p, const vec3& displacement);
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
 
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
 
     public:
         std::shared_ptr<hittable> ptr;
         vec3 offset;
+        bool hasbox;
+        aabb bbox;  // moved bounds, to reject packets passing by
 };
 
 class rotate_y final : public hittable {
     public:
-        rotate_y(std::shared_ptr<hittable> p, double angle);
+        rotate_y(std::shared_ptr<hittable> p, real angle);
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
 
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override {
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override {
             output_box = bbox;
             return hasbox;
         }
 
+    private:
+        ray _rotated(const ray& r) const;
+        void _rotate_back(const ray& rotated_r, hit_record& rec) const;
+
     public:
         std::shared_ptr<hittable> ptr;
-        double sin_theta;
-        double cos_theta;
+        real sin_theta;
+        real cos_theta;
         bool hasbox;
         aabb bbox;
 };
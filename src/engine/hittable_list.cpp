@@ -1,14 +1,19 @@
 #include "hittable_list.h"
 
 #include "aabb.h"
+#include "path_statistics.h"
 
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+#include <bit>
+
+bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     hit_record temp_rec;
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
+    count_traversal(&path_statistics::hittable_tests, objects.size());
     for (const auto& object : objects) {
         if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+            count_traversal(&path_statistics::hittable_hits);
             hit_anything = true;
             closest_so_far = temp_rec.t;
             rec = temp_rec;
@@ -18,7 +23,22 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
     return hit_anything;
 }
 
-bool hittable_list::bounding_box(double time0, double time1, aabb& output_box) const {
+int hittable_list::hit_packet(const ray_packet& packet, int mask, real t_min,
+                              packet_distances& t_max, packet_records& rec) const {
+    const auto lanes = static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(mask)));
+    int hits = 0;
+
+    count_traversal(&path_statistics::hittable_tests, objects.size()*lanes);
+    for (const auto& object : objects) {
+        const int object_hits = object->hit_packet(packet, mask, t_min, t_max, rec);
+        count_traversal(&path_statistics::hittable_hits, static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(object_hits))));
+        hits |= object_hits;
+    }
+
+    return hits;
+}
+
+bool hittable_list::bounding_box(real time0, real time1, aabb& output_box) const {
     if (objects.empty()) return false;
 
     aabb temp_box;
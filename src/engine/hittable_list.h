@@ -16,8 +16,10 @@ class hittable_list : public hittable {
         void clear() { objects.clear(); }
         void add(std::shared_ptr<hittable> object) { objects.push_back(object); }
 
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
 
     public:
         std::vector<std::shared_ptr<hittable>> objects;
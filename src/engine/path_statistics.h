@@ -0,0 +1,84 @@
+#ifndef PATH_STATISTICS_H
+#define PATH_STATISTICS_H
+
+#include "tracer_constants.h"
+
+#include <cstdint>
+#include <ostream>
+
+// Bounce statistics of the path integrator and traversal counters,
+// accumulated per worker and merged at the end of a run.
+struct path_statistics
+{
+    std::uint64_t paths = 0;        // camera paths traced
+    std::uint64_t bounces = 0;      // scattering events (i.e. secondary rays)
+    std::uint64_t escaped = 0;      // paths leaving the scene
+    std::uint64_t absorbed = 0;     // paths ending on a non scattering material
+    std::uint64_t roulette = 0;     // paths terminated by russian roulette
+    std::uint64_t depth_limit = 0;  // paths reaching the maximum depth
+
+    // traversal counters, only gathered with tracer_constants::traversal_statistics
+    std::uint64_t bvh_queries = 0;      // closest hit queries on a BVH
+    std::uint64_t nodes_visited = 0;    // BVH nodes popped during these queries
+    std::uint64_t hittable_tests = 0;   // hittables tested by BVH leaves and hittable lists
+    std::uint64_t hittable_hits = 0;    // tests returning a closer hit
+
+    path_statistics& operator+=(const path_statistics& other)
+    {
+        paths += other.paths;
+        bounces += other.bounces;
+        escaped += other.escaped;
+        absorbed += other.absorbed;
+        roulette += other.roulette;
+        depth_limit += other.depth_limit;
+        bvh_queries += other.bvh_queries;
+        nodes_visited += other.nodes_visited;
+        hittable_tests += other.hittable_tests;
+        hittable_hits += other.hittable_hits;
+        return *this;
+    }
+
+    std::uint64_t rays() const { return paths + bounces; }
+
+    double mean_path_length() const {
+        return paths ? static_cast<double>(rays()) / static_cast<double>(paths) : 0.0;
+    }
+
+    double per_ray(std::uint64_t count) const {
+        return rays() ? static_cast<double>(count) / static_cast<double>(rays()) : 0.0;
+    }
+};
+
+// Statistics of the calling worker, collected by the engine after every tile
+inline path_statistics& thread_path_statistics()
+{
+    thread_local path_statistics thread_stats;
+    return thread_stats;
+}
+
+// Traversal counter increment, compiled out unless tracer_constants::traversal_statistics is set
+inline void count_traversal(std::uint64_t path_statistics::* counter, std::uint64_t n = 1)
+{
+    if constexpr (tracer_constants::traversal_statistics)
+        thread_path_statistics().*counter += n;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const path_statistics& stats)
+{
+    out << "paths: " << stats.paths
+        << " | rays: " << stats.rays() << " (" << stats.paths << " primary, " << stats.bounces << " secondary)"
+        << " | mean path length: " << stats.mean_path_length()
+        << " | escaped: " << stats.escaped
+        << " | absorbed: " << stats.absorbed
+        << " | russian roulette: " << stats.roulette
+        << " | depth limit: " << stats.depth_limit;
+    if constexpr (tracer_constants::traversal_statistics) {
+        out << " | bvh queries: " << stats.bvh_queries
+            << " | nodes/ray: " << stats.per_ray(stats.nodes_visited)
+            << " | tests/ray: " << stats.per_ray(stats.hittable_tests)
+            << " | hits/ray: " << stats.per_ray(stats.hittable_hits);
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "tracer_utils.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <type_traits>
+
+// Four rays traced together, typically the camera rays of 2x2 neighbouring
+// pixels, and the two box tests of packet traversal:
+// - a frustum test bounding the whole packet with interval arithmetic, which
+//   rejects a box for every ray at once,
+// - a SIMD slab test returning the lanes that hit a box.
+// Lanes are selected by bit masks, bit k standing for rays[k].
+class ray_packet {
+    public:
+        static constexpr int size = 4;
+        static constexpr int all_lanes = (1 << size) - 1;
+
+        // Relative bound of the rounding errors of the single precision slab
+        // test, as in wide_bvh
+        static constexpr float far_scale = 1.0f + 4.0f*0x1p-23f;
+
+        ray_packet() = default;
+
+        // Only the rays of the lanes in mask are bounded by the box tests
+        ray_packet(const std::array<ray,size>& _rays, int mask) : rays(_rays), lanes(mask) {}
+
+        // Same packet with every origin moved by offset
+        ray_packet translated(const vec3& offset) const {
+            ray_packet moved = *this;
+            for (auto& r : moved.rays)
+                r = ray(r.origin() + offset, r.direction(), r.time());
+            moved.prepared = false;
+            return moved;
+        }
+
+        // Conservative: false only when no ray of the packet can hit the box
+        // within [t_min,t_max]. Bounds are anything indexable by axis.
+        template<typename Bounds>
+        bool frustum_hit(const Bounds& bounds_min, const Bounds& bounds_max, double t_min, double t_max) const {
+            _prepare();
+            if (!coherent)
+                return true;
+
+            // Relative slack covering the rounding of the interval products,
+            // and of the distances of the primitives in single precision
+            constexpr double slack = std::is_same_v<real,float> ? 1e-5 : 1e-9;
+
+            auto t_near = t_min;
+            auto t_far = t_max;
+            for (int a = 0; a < 3; ++a) {
+                const bool negative = inv_min[a] < 0.0;
+                const double near_plane = negative ? bounds_max[a] : bounds_min[a];
+                const double far_plane = negative ? bounds_min[a] : bounds_max[a];
+
+                // lowest entry and highest exit distances of the packet, from
+                // the intervals of the plane distances and inverse directions
+                const auto near_lo = lowest_product(near_plane - origin_max[a], near_plane - origin_min[a], inv_min[a], inv_max[a]);
+                const auto far_hi = highest_product(far_plane - origin_max[a], far_plane - origin_min[a], inv_min[a], inv_max[a]);
+                t_near = std::max(t_near, near_lo - slack*std::fabs(near_lo));
+                t_far = std::min(t_far, far_hi + slack*std::fabs(far_hi));
+                if (t_far < t_near)
+                    return false;
+            }
+            return true;
+        }
+
+        // Lanes of mask whose ray may hit the box within [t_min,t_max[lane]],
+        // single precision and conservative like the wide_bvh slab test
+        int box_mask(const float bounds_min[3], const float bounds_max[3], int mask, float4 t_min, float4 t_max) const {
+            _prepare();
+            auto t_near = t_min;
+            auto t_far = t_max * float4(far_scale);
+            for (size_t a = 0; a < 3; ++a) {
+                const auto near_bounds = select_negative(inv_dir[a], float4(bounds_max[a]), float4(bounds_min[a]));
+                const auto far_bounds = select_negative(inv_dir[a], float4(bounds_min[a]), float4(bounds_max[a]));
+                t_near = max((near_bounds - origin_near[a]) * inv_dir[a], t_near);
+                t_far = min((far_bounds - origin_far[a]) * inv_dir[a], t_far);
+            }
+            return less_equal_mask(t_near, t_far * float4(far_scale)) & mask;
+        }
+
+    public:
+        std::array<ray,size> rays;
+        // random streams of the rays, swapped in around the hit calls of the
+        // hittables drawing numbers while intersecting (null: thread_rng)
+        std::array<pcg32*,size> streams{};
+
+    private:
+        // The box test data is only computed once a box is tested: packets
+        // going through transforms or lists of primitives never need it.
+        void _prepare() const {
+            if (prepared)
+                return;
+            prepared = true;
+
+            origin_min = origin_max = rays[static_cast<size_t>(std::countr_zero(static_cast<unsigned>(lanes)))].origin();
+            inv_min = vec3(infinity, infinity, infinity);
+            inv_max = -inv_min;
+            coherent = true;
+
+            alignas(16) float inv_lanes[3][size] = {};
+            alignas(16) float near_lanes[3][size] = {};
+            alignas(16) float far_lanes[3][size] = {};
+            for (int k = 0; k < size; ++k) {
+                if (!(lanes & (1 << k)))
+                    continue;
+                const auto& r = rays[static_cast<size_t>(k)];
+                for (int a = 0; a < 3; ++a) {
+                    const auto inv = 1/r.direction()[a];
+                    origin_min[a] = std::min(origin_min[a], r.origin()[a]);
+                    origin_max[a] = std::max(origin_max[a], r.origin()[a]);
+                    inv_min[a] = std::min(inv_min[a], inv);
+                    inv_max[a] = std::max(inv_max[a], inv);
+
+                    // origins nudged by one ulp towards the near and far planes
+                    // to cover the double to float rounding
+                    const auto inv_f = static_cast<float>(inv);
+                    const auto o = static_cast<float>(r.origin()[a]);
+                    const auto delta = std::fabs(o)*0x1p-23f;
+                    inv_lanes[a][k] = inv_f;
+                    near_lanes[a][k] = inv_f < 0.0f ? o - delta : o + delta;
+                    far_lanes[a][k] = inv_f < 0.0f ? o + delta : o - delta;
+                }
+            }
+
+            for (int a = 0; a < 3; ++a) {
+                // the interval bounds are only meaningful when every ray goes
+                // the same way along every axis
+                if (!std::isfinite(inv_min[a]) || !std::isfinite(inv_max[a]) || (inv_min[a] < 0.0) != (inv_max[a] < 0.0))
+                    coherent = false;
+                inv_dir[static_cast<size_t>(a)] = float4::load(inv_lanes[a]);
+                origin_near[static_cast<size_t>(a)] = float4::load(near_lanes[a]);
+                origin_far[static_cast<size_t>(a)] = float4::load(far_lanes[a]);
+            }
+        }
+
+        static double lowest_product(double lo, double hi, double inv_lo, double inv_hi) {
+            return std::min({lo*inv_lo, lo*inv_hi, hi*inv_lo, hi*inv_hi});
+        }
+
+        static double highest_product(double lo, double hi, double inv_lo, double inv_hi) {
+            return std::max({lo*inv_lo, lo*inv_hi, hi*inv_lo, hi*inv_hi});
+        }
+
+    private:
+        int lanes = 0;
+
+        // box test data, computed by _prepare
+        mutable bool prepared = false;
+        mutable point3 origin_min, origin_max;
+        mutable vec3 inv_min, inv_max;
+        mutable bool coherent = false;
+        mutable std::array<float4,3> inv_dir, origin_near, origin_far;
+};
+
+#endif
@@ -2,15 +2,18 @@
 
 #include "camera.h"
 #include "color.h"
+#include "cpu_dispatch.h"
 #include "engine.h"
 #include "frame_allocator.h"
 #include "gui.h"
 #include "tracer_constants.h"
 #include "scene_manager.h"
+#include "trace.h"
 
 #include <array>
 #include <chrono>
 #include <iostream>
+#include <string>
 
 namespace tc = tracer_constants;
 
@@ -25,6 +28,58 @@ int main(int argc, char **argv) try
         alias = static_cast<scene_alias>(std::atoi(argv[1])); // TODO-AM : no error checking! :-(
     } 
 
+    // Optional worker thread count parameter (0 means all hardware threads)
+    size_t thread_count = tc::thread_count;
+    if(argc >= 3)
+    {
+        thread_count = static_cast<size_t>(std::max(0,std::atoi(argv[2])));
+    }
+
+    // Optional cost heatmap parameter ("none", "time" or "traversal")
+    cost_metric metric = cost_metric::none;
+    if(argc >= 4)
+    {
+        const std::string metric_name = argv[3];
+        if(metric_name == "time")
+            metric = cost_metric::time;
+        else if(metric_name == "traversal")
+            metric = cost_metric::traversal;
+        else if(metric_name != "none")
+            std::cerr << "unknown cost metric " << metric_name << ", expected time or traversal" << std::endl;
+    }
+
+    // Optional Chrome trace output parameter (e.g. trace.json, empty for no trace)
+    std::string trace_path;
+    if(argc >= 5 && argv[4][0] != '\0')
+    {
+        trace_path = argv[4];
+        trace_recorder::instance().enable();
+        trace_recorder::instance().set_thread_name("main");
+    }
+
+    // Optional sampler parameter ("independent", "stratified", "sobol" or "blue_noise")
+    sampler_kind sampling = sampler_kind::sobol;
+    if(argc >= 6 && !sampler::parse(argv[5], sampling))
+    {
+        std::cerr << "unknown sampler " << argv[5] << ", using " << sampler::name(sampling) << std::endl;
+    }
+
+    // Optional engine mode parameter (see engine_mode, e.g. "progressive" or "wavefront")
+    engine_mode mode = engine_mode::adaptive;
+    if(argc >= 7 && !parse_engine_mode(argv[6], mode))
+    {
+        std::cerr << "unknown engine mode " << argv[6] << ", using " << engine_mode_name(mode) << std::endl;
+    }
+
+    // Optional time budget parameter in milliseconds, progressive mode only (0 means no deadline)
+    std::chrono::milliseconds time_budget{0};
+    if(argc >= 8)
+    {
+        time_budget = std::chrono::milliseconds{std::max(0,std::atoi(argv[7]))};
+        if(time_budget.count() > 0 && mode != engine_mode::progressive)
+            std::cerr << "the time budget only applies to the progressive mode" << std::endl;
+    }
+
     // Scene description
     scene_manager scene_mgr;
     scene world = scene_mgr.build(alias);
@@ -36,25 +91,54 @@ int main(int argc, char **argv) try
     
     // Render
     std::cout << "output resolution: " << tc::image_width << "x" << tc::image_height << std::endl;
+    std::cout << "kernels: " << cpu_dispatch::kernels().name << std::endl;
+    std::cout << "sampler: " << sampler::name(sampling) << std::endl;
+    std::cout << "engine mode: " << engine_mode_name(mode) << std::endl;
 
     // Allocate rendering frame
     frame_allocator<std::uint8_t,tc::frame_size,1> frame_alloc;
     auto& output_image = frame_alloc.get_frame(0,0);
 
-    engine<tc::image_width,tc::image_height,tc::color_channels> eng( cam, engine_mode::adaptive );
+    engine<tc::image_width,tc::image_height,tc::color_channels> eng( cam, mode, thread_count );
     eng.set_scene(world.objects,world.background);
+    eng.set_cost_metric(metric);
+    eng.set_sampler(sampling);
+    eng.set_time_budget(time_budget);
+    eng.set_pass_callback([](const std::uint8_t*, int samples) {
+        std::cout << "progressive pass done, " << samples << " samples per pixel" << std::endl;
+    });
     auto elapsed_ms = eng.run( output_image.data() );
     
     std::cout << std::endl << "Rendering computed in milliseconds: " << elapsed_ms << " ms" << std::endl;
+
+    std::cout << std::endl << "Path statistics: " << eng.stats() << std::endl;
     
-    const auto total_rays = tc::image_width * tc::image_height * tracer_constants::samples_per_pixel;
-    const auto ray_processing_rate = static_cast<float>(total_rays) / elapsed_ms;
+    const auto total_rays = eng.stats().rays();
+    const auto ray_processing_rate = static_cast<double>(total_rays) / elapsed_ms;
     
     std::cout << std::endl << "Processing rate: " << ray_processing_rate << "kRay/s" << std::endl;
     
     gui::display( output_image.data(), tc::image_width, tc::image_height, 2 );
     
-    imageio::save_image("output.png",tc::image_width,tc::image_height,tc::color_channels,output_image.data());
+    // scoped trace
+    {
+        scoped_trace trace("image write", "io");
+        imageio::save_image("output.png",tc::image_width,tc::image_height,tc::color_channels,output_image.data());
+
+        if(metric != cost_metric::none)
+        {
+            imageio::save_heatmap("output_cost.png",tc::image_width,tc::image_height,eng.cost_map().data());
+            imageio::save_float_image("output_cost.pfm",tc::image_width,tc::image_height,eng.cost_map().data());
+        }
+    }
+
+    if(!trace_path.empty())
+    {
+        if(trace_recorder::instance().write(trace_path))
+            std::cout << "trace written to " << trace_path << std::endl;
+        else
+            std::cerr << "cannot write trace to " << trace_path << std::endl;
+    }
     
     return EXIT_SUCCESS;
 }
@@ -5,20 +5,23 @@
 
 #include <algorithm>
 
-class aabb {
+template<typename T>
+class aabb_t {
     public:
-        aabb() = default;
-        aabb(const point3& a, const point3& b) { minimum = a; maximum = b;}
+        using vector = vec3_t<T>;
 
-        point3 min() const {return minimum; }
-        point3 max() const {return maximum; }
+        aabb_t() = default;
+        aabb_t(const vector& a, const vector& b) { minimum = a; maximum = b;}
 
-        inline bool hit(const ray& r, double t_min, double t_max) const {
+        vector min() const {return minimum; }
+        vector max() const {return maximum; }
+
+        inline bool hit(const ray_t<T>& r, T t_min, T t_max) const {
             for (int a = 0; a < 3; a++) {
-                auto invD = 1.0f / r.direction()[a];
+                auto invD = 1 / r.direction()[a];
                 auto t0 = (min()[a] - r.origin()[a]) * invD;
                 auto t1 = (max()[a] - r.origin()[a]) * invD;
-                if (invD < 0.0f)
+                if (invD < 0)
                     std::swap(t0, t1);
                 t_min = t0 > t_min ? t0 : t_min;
                 t_max = t1 < t_max ? t1 : t_max;
@@ -28,14 +31,24 @@ class aabb {
             return true;
         }
 
-        point3 minimum;
-        point3 maximum;
+        vector centroid() const { return T(0.5)*(minimum + maximum); }
+
+        T surface_area() const {
+            const auto d = maximum - minimum;
+            return 2*(d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+        }
+
+        vector minimum;
+        vector maximum;
 };
 
-inline aabb surrounding_box(aabb box0, aabb box1) {
-    point3 small(min(box0.min(),box1.min()));
-    point3 big(max(box0.max(),box1.max()));
-    return aabb(small,big);
+using aabb = aabb_t<real>;
+
+template<typename T>
+inline aabb_t<T> surrounding_box(aabb_t<T> box0, aabb_t<T> box1) {
+    vec3_t<T> small(min(box0.min(),box1.min()));
+    vec3_t<T> big(max(box0.max(),box1.max()));
+    return aabb_t<T>(small,big);
 }
 
 #endif
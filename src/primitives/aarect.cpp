@@ -1,6 +1,8 @@
 #include "aarect.h"
 
-bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+#include <bit>
+
+bool xy_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     auto t = (k-r.origin().z()) / r.direction().z();
     if (t < t_min || t > t_max)
         return false;
@@ -13,12 +15,12 @@ bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
     return true;
 }
 
-bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool xz_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     auto t = (k-r.origin().y()) / r.direction().y();
     if (t < t_min || t > t_max)
         return false;
@@ -31,12 +33,12 @@ bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
     return true;
 }
 
-bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool yz_rect::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     auto t = (k-r.origin().x()) / r.direction().x();
     if (t < t_min || t > t_max)
         return false;
@@ -49,7 +51,22 @@ bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
     rec.t = t;
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
     return true;
 }
+
+int xy_rect::hit_packet(const ray_packet& packet, int mask, real t_min,
+                        packet_distances& t_max, packet_records& rec) const {
+    return hit_lanes(*this, packet, mask, t_min, t_max, rec);
+}
+
+int xz_rect::hit_packet(const ray_packet& packet, int mask, real t_min,
+                        packet_distances& t_max, packet_records& rec) const {
+    return hit_lanes(*this, packet, mask, t_min, t_max, rec);
+}
+
+int yz_rect::hit_packet(const ray_packet& packet, int mask, real t_min,
+                        packet_distances& t_max, packet_records& rec) const {
+    return hit_lanes(*this, packet, mask, t_min, t_max, rec);
+}
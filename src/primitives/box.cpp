@@ -1,5 +1,9 @@
 #include "box.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 box::box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr) {
     box_min = p0;
     box_max = p1;
@@ -12,8 +16,28 @@ box::box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr) {
 
     sides.add(std::make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
     sides.add(std::make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
+
+    // one ulp outwards covers the rounding to the nearest float
+    for (int a = 0; a < 3; ++a) {
+        lane_min[a] = std::nextafter(static_cast<float>(box_min[a]), -std::numeric_limits<float>::infinity());
+        lane_max[a] = std::nextafter(static_cast<float>(box_max[a]), std::numeric_limits<float>::infinity());
+    }
 }
 
-bool box::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+bool box::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     return sides.hit(r, t_min, t_max, rec);
 }
+
+int box::hit_packet(const ray_packet& packet, int mask, real t_min,
+                    packet_distances& t_max, packet_records& rec) const {
+    // the six sides are skipped at once when the packet passes by, then for
+    // every lane missing the box
+    const auto farthest = *std::max_element(t_max.begin(), t_max.end());
+    if (!packet.frustum_hit(box_min, box_max, t_min, farthest))
+        return 0;
+
+    const float4 lane_t_max(static_cast<float>(t_max[0]), static_cast<float>(t_max[1]),
+                            static_cast<float>(t_max[2]), static_cast<float>(t_max[3]));
+    const int lanes = packet.box_mask(lane_min, lane_max, mask, float4(static_cast<float>(t_min)), lane_t_max);
+    return lanes != 0 ? sides.hit_packet(packet, lanes, t_min, t_max, rec) : 0;
+}
@@ -10,9 +10,11 @@ class box final : public hittable  {
     public:
         box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr);
 
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
 
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override {
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override {
             output_box = aabb(box_min, box_max);
             return true;
         }
@@ -21,6 +23,11 @@ class box final : public hittable  {
         point3 box_min;
         point3 box_max;
         hittable_list sides;
+
+    private:
+        // bounds in single precision, rounded outwards, for the packet slab test
+        float lane_min[3];
+        float lane_max[3];
 };
 
 #endif
@@ -1,57 +1,67 @@
 #include "bvh.h"
 
-bvh_node::bvh_node(
-    const std::vector<std::shared_ptr<hittable>>& src_objects,
-    size_t start, size_t end, double time0, double time1
-) {
-    auto objects = src_objects; // Create a modifiable array of the source scene objects
-
-    int axis = random_int(0,2);
-    auto comparator = (axis == 0) ? box_x_compare
-                    : (axis == 1) ? box_y_compare
-                                  : box_z_compare;
-
-    size_t object_span = end - start;
-
-    if (object_span == 1) {
-        left = right = objects[start];
-    } else if (object_span == 2) {
-        if (comparator(objects[start], objects[start+1])) {
-            left = objects[start];
-            right = objects[start+1];
-        } else {
-            left = objects[start+1];
-            right = objects[start];
-        }
-    } else {
-        std::sort(objects.begin() + static_cast<std::ptrdiff_t>(start), objects.begin() + static_cast<std::ptrdiff_t>(end), comparator);
+#include "tracer_constants.h"
+
+#include <bit>
 
-        auto mid = start + object_span/2;
-        left = std::make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = std::make_shared<bvh_node>(objects, mid, end, time0, time1);
+bvh_node::bvh_node(const hittable_list& list, real time0, real time1) {
+    std::vector<aabb> boxes;
+    boxes.reserve(list.objects.size());
+
+    // primitive bounds are only computed once
+    for (const auto& object : list.objects) {
+        aabb object_box;
+        if (!object->bounding_box(time0, time1, object_box))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+        boxes.push_back(object_box);
     }
 
-    aabb box_left, box_right;
+    tree = linear_bvh(boxes);
+    if constexpr (tracer_constants::use_wide_bvh)
+        wide_tree = wide_bvh(tree);
 
-    if (  !left->bounding_box (time0, time1, box_left)
-       || !right->bounding_box(time0, time1, box_right)
-    )
-        std::cerr << "No bounding box in bvh_node constructor.\n";
+    // store the primitives in leaf order so that every leaf is a contiguous range
+    objects.reserve(list.objects.size());
+    primitives.reserve(list.objects.size());
+    for (auto index : tree.primitive_order()) {
+        objects.push_back(list.objects[index]);
+        primitives.push_back(objects.back().get());
+    }
 
-    box = surrounding_box(box_left, box_right);
+    std::cout << "bvh built over " << objects.size() << " primitives (" << tree.node_array().size() << " nodes, "
+              << tree.leaf_count() << " leaves, SAH cost " << tree.sah_cost() << ")" << std::endl;
 }
 
-bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-    if (!box.hit(r, t_min, t_max))
-        return false;
+bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+    const auto intersect = [this](std::uint32_t i, const ray& r, real t_min, real t_max, hit_record& rec) {
+        return primitives[i]->hit(r, t_min, t_max, rec);
+    };
 
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    if constexpr (tracer_constants::use_wide_bvh)
+        return wide_tree.hit(r, t_min, t_max, rec, intersect);
+    else
+        return tree.hit(r, t_min, t_max, rec, intersect);
+}
+
+int bvh_node::hit_packet(const ray_packet& packet, int mask, real t_min,
+                         packet_distances& t_max, packet_records& rec) const {
+    const auto intersect = [this, &packet](std::uint32_t first, std::uint32_t count, int lanes, real t_min,
+                                           packet_distances& t_max, packet_records& rec) {
+        const auto lane_count = static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(lanes)));
+        count_traversal(&path_statistics::hittable_tests, count*lane_count);
+        int hits = 0;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            const int primitive_hits = primitives[i]->hit_packet(packet, lanes, t_min, t_max, rec);
+            count_traversal(&path_statistics::hittable_hits, static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(primitive_hits))));
+            hits |= primitive_hits;
+        }
+        return hits;
+    };
 
-    return hit_left || hit_right;
+    return tree.hit_packet(packet, mask, t_min, t_max, rec, intersect);
 }
 
-bool bvh_node::bounding_box(double time0, double time1, aabb& output_box) const {
-    output_box = box;
+bool bvh_node::bounding_box(real time0, real time1, aabb& output_box) const {
+    output_box = tree.bounds();
     return true;
 }
@@ -5,47 +5,32 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
-
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+
+// Bounding volume hierarchy over a list of hittables. The tree is built with a
+// binned surface area heuristic and stored as a flat linear_bvh, then collapsed
+// into a 4-wide BVH traversed with SIMD box tests (see tracer_constants::use_wide_bvh).
+// Traversal only performs virtual calls on the primitives of the leaves it reaches.
+// Packets walk the binary tree, the leaf primitives being handed the lanes
+// that reach them.
 class bvh_node final : public hittable {
     public:
-        bvh_node(const hittable_list& list, double time0, double time1)
-            : bvh_node(list.objects, 0, list.objects.size(), time0, time1)
-        {}
+        bvh_node(const hittable_list& list, real time0, real time1);
 
-        bvh_node(
-            const std::vector<std::shared_ptr<hittable>>& src_objects,
-            size_t start, size_t end, double time0, double time1);
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
 
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+        // Expected cost of a ray traversal, in primitive intersection units
+        double sah_cost() const { return tree.sah_cost(); }
 
     public:
-        std::shared_ptr<hittable> left;
-        std::shared_ptr<hittable> right;
-        aabb box;
+        linear_bvh tree;
+        wide_bvh wide_tree;
+        std::vector<std::shared_ptr<hittable>> objects; // in build order
+        std::vector<const hittable*> primitives;        // non-owning view of objects
 };
 
-inline bool box_compare(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b, int axis) {
-    aabb box_a;
-    aabb box_b;
-
-    if (!a->bounding_box(0,0, box_a) || !b->bounding_box(0,0, box_b))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
-
-    return box_a.min().e[axis] < box_b.min().e[axis];
-}
-
-
-inline bool box_x_compare (const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b) {
-    return box_compare(a, b, 0);
-}
-
-inline bool box_y_compare (const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b) {
-    return box_compare(a, b, 1);
-}
-
-inline bool box_z_compare (const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b) {
-    return box_compare(a, b, 2);
-}
-
 #endif
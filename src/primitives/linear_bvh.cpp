@@ -0,0 +1,204 @@
+#include "linear_bvh.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+struct sah_bin {
+    aabb box;
+    size_t count = 0;
+};
+
+void grow(aabb& box, const aabb& other, bool& empty) {
+    box = empty ? other : surrounding_box(box, other);
+    empty = false;
+}
+
+// Round to single precision without ever shrinking the box.
+float round_down(double v) {
+    auto f = static_cast<float>(v);
+    return static_cast<double>(f) > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+float round_up(double v) {
+    auto f = static_cast<float>(v);
+    return static_cast<double>(f) < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+double surface_area(const linear_bvh_node& node) {
+    const double dx = node.bounds_max[0] - node.bounds_min[0];
+    const double dy = node.bounds_max[1] - node.bounds_min[1];
+    const double dz = node.bounds_max[2] - node.bounds_min[2];
+    return 2.0*(dx*dy + dy*dz + dz*dx);
+}
+
+std::atomic<std::int64_t> build_time_ns{0};
+
+} // namespace
+
+double linear_bvh::build_time_ms() {
+    return static_cast<double>(build_time_ns.load()) * 1e-6;
+}
+
+void linear_bvh::add_build_time(std::chrono::steady_clock::duration elapsed) {
+    build_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+linear_bvh::linear_bvh(const std::vector<aabb>& primitive_boxes) {
+    if (primitive_boxes.empty())
+        return;
+
+    scoped_trace trace("bvh build", "scene");
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<primitive_info> infos;
+    infos.reserve(primitive_boxes.size());
+    for (size_t i = 0; i < primitive_boxes.size(); ++i)
+        infos.push_back({static_cast<std::uint32_t>(i), primitive_boxes[i], primitive_boxes[i].centroid()});
+
+    nodes.reserve(2*primitive_boxes.size());
+    ordered_primitives.reserve(primitive_boxes.size());
+
+    cost = _build(infos, 0, infos.size(), 0);
+    nodes.shrink_to_fit();
+
+    root_box = aabb(
+        point3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]),
+        point3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2]));
+
+    add_build_time(std::chrono::steady_clock::now() - start);
+}
+
+double linear_bvh::_build(std::vector<primitive_info>& infos, size_t start, size_t end, int depth) {
+    const size_t object_span = end - start;
+
+    aabb centroid_box(infos[start].centroid, infos[start].centroid);
+    aabb box = infos[start].box;
+    for (size_t i = start+1; i < end; ++i) {
+        box = surrounding_box(box, infos[i].box);
+        centroid_box = aabb(min(centroid_box.min(), infos[i].centroid), max(centroid_box.max(), infos[i].centroid));
+    }
+
+    // depth-first layout: the node is emitted before its children
+    const auto node_index = nodes.size();
+    nodes.push_back({});
+    for (int a = 0; a < 3; ++a) {
+        nodes[node_index].bounds_min[a] = round_down(box.min()[a]);
+        nodes[node_index].bounds_max[a] = round_up(box.max()[a]);
+    }
+
+    const auto make_leaf = [&]() {
+        ++leaves;
+        nodes[node_index].offset = static_cast<std::uint32_t>(ordered_primitives.size());
+        nodes[node_index].count = static_cast<std::uint16_t>(object_span);
+        for (size_t i = start; i < end; ++i)
+            ordered_primitives.push_back(infos[i].index);
+        return static_cast<double>(object_span);
+    };
+
+    if (object_span == 1)
+        return make_leaf();
+
+    // Evaluate the SAH at every bin boundary of every axis.
+    const auto parent_area = box.surface_area();
+    auto best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1;
+    int best_split = 0;
+
+    const auto bin_index = [&](const point3& centroid, int axis) {
+        const auto extent = centroid_box.max()[axis] - centroid_box.min()[axis];
+        const auto b = static_cast<int>(sah_bins * (centroid[axis] - centroid_box.min()[axis]) / extent);
+        return std::clamp(b, 0, sah_bins-1);
+    };
+
+    for (int axis = 0; axis < 3 && depth < sah_max_depth; ++axis) {
+        if (centroid_box.max()[axis] - centroid_box.min()[axis] <= 0.0)
+            continue;
+
+        std::array<sah_bin,sah_bins> bins;
+        std::array<bool,sah_bins> empty;
+        empty.fill(true);
+        for (size_t i = start; i < end; ++i) {
+            const auto b = static_cast<size_t>(bin_index(infos[i].centroid, axis));
+            bins[b].count++;
+            grow(bins[b].box, infos[i].box, empty[b]);
+        }
+
+        // right to left sweep gives the area and count above each boundary
+        std::array<double,sah_bins> right_area{};
+        std::array<size_t,sah_bins> right_count{};
+        aabb right_box;
+        bool right_empty = true;
+        size_t count = 0;
+        for (int b = sah_bins-1; b > 0; --b) {
+            if (!empty[static_cast<size_t>(b)])
+                grow(right_box, bins[static_cast<size_t>(b)].box, right_empty);
+            count += bins[static_cast<size_t>(b)].count;
+            right_count[static_cast<size_t>(b)] = count;
+            right_area[static_cast<size_t>(b)] = right_empty ? 0.0 : right_box.surface_area();
+        }
+
+        aabb left_box;
+        bool left_empty = true;
+        count = 0;
+        for (int b = 0; b < sah_bins-1; ++b) {
+            if (!empty[static_cast<size_t>(b)])
+                grow(left_box, bins[static_cast<size_t>(b)].box, left_empty);
+            count += bins[static_cast<size_t>(b)].count;
+            const auto n_right = right_count[static_cast<size_t>(b+1)];
+            if (count == 0 || n_right == 0)
+                continue;
+            const auto split_cost = traversal_cost
+                + (static_cast<double>(count)*left_box.surface_area()
+                +  static_cast<double>(n_right)*right_area[static_cast<size_t>(b+1)]) / parent_area;
+            if (split_cost < best_cost) {
+                best_cost = split_cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    const auto leaf_cost = static_cast<double>(object_span);
+    if (object_span <= max_leaf_size && (best_axis < 0 || leaf_cost <= best_cost))
+        return make_leaf();
+
+    auto first = infos.begin() + static_cast<std::ptrdiff_t>(start);
+    auto last = infos.begin() + static_cast<std::ptrdiff_t>(end);
+    auto middle = first + static_cast<std::ptrdiff_t>(object_span/2);
+
+    int split_axis = best_axis;
+    if (best_axis >= 0) {
+        middle = std::partition(first, last, [&](const primitive_info& info) {
+            return bin_index(info.centroid, best_axis) <= best_split;
+        });
+    }
+    else {
+        // coincident centroids or too deep a tree: median split on the widest axis
+        const auto extent = centroid_box.max() - centroid_box.min();
+        split_axis = extent.x() > extent.y() && extent.x() > extent.z() ? 0 : (extent.y() > extent.z() ? 1 : 2);
+        std::nth_element(first, middle, last, [&](const primitive_info& a, const primitive_info& b) {
+            return a.centroid[split_axis] < b.centroid[split_axis];
+        });
+    }
+
+    const auto mid = static_cast<size_t>(middle - infos.begin());
+    const auto left_cost = _build(infos, start, mid, depth+1);
+    const auto left_area = surface_area(nodes[node_index+1]);
+
+    const auto second_child = nodes.size();
+    const auto right_cost = _build(infos, mid, end, depth+1);
+    const auto right_area = surface_area(nodes[second_child]);
+
+    nodes[node_index].offset = static_cast<std::uint32_t>(second_child);
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = static_cast<std::uint8_t>(split_axis);
+
+    if (parent_area <= 0.0)
+        return traversal_cost + left_cost + right_cost;
+    return traversal_cost + (left_area*left_cost + right_area*right_cost) / parent_area;
+}
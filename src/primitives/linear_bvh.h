@@ -0,0 +1,241 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "tracer_utils.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "path_statistics.h"
+#include "ray_packet.h"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Compact BVH node: single precision bounds, conservatively rounded outwards,
+// and either the second child index (interior nodes, the first child directly
+// follows its parent) or the first primitive of a leaf.
+struct alignas(32) linear_bvh_node {
+    float bounds_min[3];
+    float bounds_max[3];
+    std::uint32_t offset;   // interior: second child index / leaf: first primitive
+    std::uint16_t count;    // number of primitives, 0 for interior nodes
+    std::uint8_t axis;      // split axis of interior nodes
+    std::uint8_t pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should fit half a cache line");
+
+// Leaf intersection shared by the BVH layouts. Intersectors either take a
+// single primitive, intersect(i, r, t_min, t_max, rec), or a whole leaf,
+// intersect(first, count, r, t_min, t_max, rec), when they test several
+// primitives at once. t_max shrinks to the closest hit found.
+template<typename Intersector>
+bool intersect_leaf(Intersector& intersect, std::uint32_t first, std::uint32_t count,
+                    const ray& r, real t_min, real& t_max, hit_record& rec) {
+    count_traversal(&path_statistics::hittable_tests, count);
+    if constexpr (std::is_invocable_r_v<bool, Intersector&, std::uint32_t, std::uint32_t,
+                                        const ray&, real, real, hit_record&>) {
+        if (!intersect(first, count, r, t_min, t_max, rec))
+            return false;
+        count_traversal(&path_statistics::hittable_hits);
+        t_max = rec.t;
+        return true;
+    }
+    else {
+        bool hit_anything = false;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            if (intersect(i, r, t_min, t_max, rec)) {
+                count_traversal(&path_statistics::hittable_hits);
+                hit_anything = true;
+                t_max = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+}
+
+// Bounding volume hierarchy flattened in depth-first order in a contiguous
+// node array and traversed with an explicit stack, nearest child first.
+// Primitives are only known by index: the hierarchy is built from their
+// bounding boxes and leaf ranges refer to the build order (see primitive_order).
+class linear_bvh {
+    public:
+        linear_bvh() = default;
+        explicit linear_bvh(const std::vector<aabb>& primitive_boxes);
+
+        // Closest hit query: intersect is called on every leaf reached (see
+        // intersect_leaf), primitive indices being build order indices.
+        template<typename Intersector>
+        bool hit(const ray& r, real t_min, real t_max, hit_record& rec, Intersector&& intersect) const;
+
+        // Closest hits of the packet lanes in mask, with the per lane contract
+        // of hittable::hit_packet. The packet walks the tree as a whole, nearest
+        // child first for its first lane, SIMD slab tests giving the lanes that
+        // reach every node. intersect(first, count, lanes, t_min, t_max, rec)
+        // is called on the leaves reached and returns the lanes it hit.
+        template<typename PacketIntersector>
+        int hit_packet(const ray_packet& packet, int mask, real t_min, packet_distances& t_max,
+                       packet_records& rec, PacketIntersector&& intersect) const;
+
+        // primitive_order()[i] is the input index of the i-th primitive in build order
+        const std::vector<std::uint32_t>& primitive_order() const { return ordered_primitives; }
+
+        const std::vector<linear_bvh_node>& node_array() const { return nodes; }
+        bool empty() const { return nodes.empty(); }
+        aabb bounds() const { return root_box; }
+        double sah_cost() const { return cost; }
+        size_t leaf_count() const { return leaves; }
+
+        // Wall time spent building hierarchies (binary and wide) by this
+        // process, so that benchmarks can tell it apart from scene setup
+        static double build_time_ms();
+        static void add_build_time(std::chrono::steady_clock::duration elapsed);
+
+    public:
+        static constexpr int sah_bins = 12;
+        static constexpr size_t max_leaf_size = 4;
+        static constexpr double traversal_cost = 0.125; // relative to a primitive intersection
+        static constexpr int sah_max_depth = 64;        // deeper nodes are split at the median
+        static constexpr size_t max_stack_depth = 128;
+
+    private:
+        struct primitive_info {
+            std::uint32_t index;
+            aabb box;
+            point3 centroid;
+        };
+
+        double _build(std::vector<primitive_info>& infos, size_t start, size_t end, int depth);
+
+        static bool _box_hit(const linear_bvh_node& node, const point3& origin, const vec3& inv_dir,
+                             const std::array<int,3>& dir_is_neg, real t_min, real t_max) {
+            const real bounds[2][3] = {
+                { node.bounds_min[0], node.bounds_min[1], node.bounds_min[2] },
+                { node.bounds_max[0], node.bounds_max[1], node.bounds_max[2] } };
+            for (int a = 0; a < 3; a++) {
+                const auto t0 = (bounds[dir_is_neg[a]][a] - origin[a]) * inv_dir[a];
+                const auto t1 = (bounds[1-dir_is_neg[a]][a] - origin[a]) * inv_dir[a];
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max <= t_min)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        std::vector<linear_bvh_node> nodes;
+        std::vector<std::uint32_t> ordered_primitives;
+        aabb root_box;
+        double cost = 0.0;
+        size_t leaves = 0;
+};
+
+template<typename Intersector>
+bool linear_bvh::hit(const ray& r, real t_min, real t_max, hit_record& rec, Intersector&& intersect) const {
+    if (nodes.empty())
+        return false;
+
+    const point3 origin = r.origin();
+    const vec3 inv_dir(1.0/r.direction().x(), 1.0/r.direction().y(), 1.0/r.direction().z());
+    const std::array<int,3> dir_is_neg{ inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+    std::array<std::uint32_t,max_stack_depth> stack;
+    size_t stack_size = 0;
+    std::uint32_t current = 0;
+    bool hit_anything = false;
+    std::uint64_t visited = 0;
+
+    while (true) {
+        const auto& node = nodes[current];
+        ++visited;
+        if (_box_hit(node, origin, inv_dir, dir_is_neg, t_min, t_max)) {
+            if (node.count > 0) {
+                if (intersect_leaf(intersect, node.offset, node.count, r, t_min, t_max, rec))
+                    hit_anything = true;
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            }
+            else if (dir_is_neg[node.axis]) {
+                // the second child lies on the near side
+                stack[stack_size++] = current + 1;
+                current = node.offset;
+            }
+            else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+            }
+        }
+        else {
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+    }
+
+    count_traversal(&path_statistics::bvh_queries);
+    count_traversal(&path_statistics::nodes_visited, visited);
+    return hit_anything;
+}
+
+template<typename PacketIntersector>
+int linear_bvh::hit_packet(const ray_packet& packet, int mask, real t_min, packet_distances& t_max,
+                           packet_records& rec, PacketIntersector&& intersect) const {
+    if (nodes.empty() || mask == 0)
+        return 0;
+
+    const auto& lead = packet.rays[static_cast<size_t>(std::countr_zero(static_cast<unsigned>(mask)))];
+    const std::array<int,3> dir_is_neg{ lead.direction().x() < 0, lead.direction().y() < 0, lead.direction().z() < 0 };
+
+    const auto t_min4 = float4(static_cast<float>(t_min));
+    const auto distances = [&] {
+        return float4(static_cast<float>(t_max[0]), static_cast<float>(t_max[1]),
+                      static_cast<float>(t_max[2]), static_cast<float>(t_max[3]));
+    };
+    auto t_max4 = distances();
+
+    std::array<std::uint32_t,max_stack_depth> stack;
+    size_t stack_size = 0;
+    std::uint32_t current = 0;
+    int hits = 0;
+    std::uint64_t visited = 0;
+
+    while (true) {
+        const auto& node = nodes[current];
+        ++visited;
+        const int lanes = packet.box_mask(node.bounds_min, node.bounds_max, mask, t_min4, t_max4);
+        if (lanes != 0 && node.count > 0) {
+            const int leaf_hits = intersect(node.offset, node.count, lanes, t_min, t_max, rec);
+            if (leaf_hits != 0) {
+                hits |= leaf_hits;
+                t_max4 = distances();
+            }
+        }
+        else if (lanes != 0) {
+            if (dir_is_neg[node.axis]) {
+                stack[stack_size++] = current + 1;
+                current = node.offset;
+            }
+            else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+            }
+            continue;
+        }
+
+        if (stack_size == 0)
+            break;
+        current = stack[--stack_size];
+    }
+
+    count_traversal(&path_statistics::bvh_queries, static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(mask))));
+    count_traversal(&path_statistics::nodes_visited, visited);
+    return hits;
+}
+
+#endif
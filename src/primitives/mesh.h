@@ -2,7 +2,9 @@
 #define MESH_H
 
 #include "ressources.h"
-#include "triangle.h"
+#include "material.h"
+#include "trace.h"
+#include "triangle_mesh.h"
 
 #include "rapidobj.hpp"
 
@@ -29,6 +31,7 @@ private:
 class mesh {
     public:
         bool parse(const std::string& mesh_path) {
+            scoped_trace trace("mesh parse", "scene");
             parse_data = rapidobj::ParseFile(mesh_path);
             
             if(parse_data.error) {
@@ -64,8 +67,10 @@ class mesh {
             return true;
         }
 
-        hittable_list build() {
-            hittable_list triangles;
+        std::shared_ptr<triangle_mesh> build() {
+            scoped_trace trace("mesh build", "scene");
+            triangle_mesh::buffers data;
+            std::vector<std::shared_ptr<material>> materials;
             
             material_map_handler mmh(model_work_path);
 
@@ -73,73 +78,74 @@ class mesh {
             /* REFERENCE : https://github.com/guybrush77/rapidobj#data-layout */
             /******************************************************************/
 
-            auto get_vertice_by_index = [this]<typename T>(T index) {
-                const rapidobj::Array<float>& positions = parse_data.attributes.positions;
-                return vec3{
-                    positions[static_cast<size_t>(3*index)+0UL],
-                    positions[static_cast<size_t>(3*index)+1UL],
-                    positions[static_cast<size_t>(3*index)+2UL]};
+            // vertex attributes are shared by all triangles, split per component
+            const auto split_components = [](const rapidobj::Array<float>& values, size_t components,
+                                             std::array<std::vector<float>*,3> outputs) {
+                for (size_t c = 0; c < components; ++c)
+                    outputs[c]->reserve(values.size()/components);
+                for (size_t i = 0; i + components <= values.size(); i += components)
+                    for (size_t c = 0; c < components; ++c)
+                        outputs[c]->push_back(values[i+c]);
             };
+            const auto& attributes = parse_data.attributes;
+            split_components(attributes.positions, 3, {&data.px, &data.py, &data.pz});
+            split_components(attributes.normals, 3, {&data.nx, &data.ny, &data.nz});
+            split_components(attributes.texcoords, 2, {&data.tu, &data.tv, nullptr});
+
+            // material table: one entry per wavefront material, the texture
+            // being looked up with the interpolated texture coordinates
+            for (const auto& m : parse_data.materials) {
+                const auto Ka = m.ambient;
+                const auto Kd = m.diffuse;
+                //const auto Ks = m.specular;
+                const auto map_Kd = m.diffuse_texname;
+                if(!map_Kd.empty())
+                    materials.push_back(std::make_shared<lambertian>(mmh.get(map_Kd)));
+                else
+                    materials.push_back(std::make_shared<lambertian>(color(Ka[0]+Kd[0], Ka[1]+Kd[1], Ka[2]+Kd[2])));
+            }
+
+            // faces without material pick a random color in a small palette
+            const auto palette_start = static_cast<std::uint32_t>(materials.size());
+            constexpr std::uint32_t palette_size = 64;
+            for (std::uint32_t i = 0; i < palette_size; ++i)
+                materials.push_back(std::make_shared<lambertian>(color::random()));
 
-            auto get_texcoord_by_index = [this]<typename T>(T index) -> std::pair<double,double> {
-                const rapidobj::Array<float>& texcoords = parse_data.attributes.texcoords;
-                return {texcoords[static_cast<size_t>(2*index)+0UL],
-                        texcoords[static_cast<size_t>(2*index)+1UL]};
+            const auto to_index = [](int index) {
+                return index < 0 ? triangle_mesh::no_index : static_cast<std::uint32_t>(index);
             };
             
             for (const auto& shape : parse_data.shapes) {
                 const rapidobj::Array<rapidobj::Index>& indices = shape.mesh.indices;
                 const rapidobj::Array<std::int32_t>& material_ids = shape.mesh.material_ids;
                 
-                //std::cout << "shape: " << indices.size() << std::endl;
-                
                 for(size_t i=0; i<indices.size()/3; ++i) {
-                    if(!parse_data.materials.empty()) {
-                        rapidobj::Material m = parse_data.materials[static_cast<size_t>(material_ids[i])];
-                        const auto Ka = m.ambient;
-                        const auto Kd = m.diffuse;
-                        //const auto Ks = m.specular;
-                        const auto map_Kd = m.diffuse_texname;
-                        if(!map_Kd.empty()) {
-                            //std::cout << "material: " << map_Kd << std::endl;
-
-                            auto capsule_texture = mmh.get(map_Kd);
-
-                            auto [u1,v1] = get_texcoord_by_index(indices[3*i + 0].texcoord_index);
-                            auto [u2,v2] = get_texcoord_by_index(indices[3*i + 1].texcoord_index);
-                            auto [u3,v3] = get_texcoord_by_index(indices[3*i + 2].texcoord_index);
-
-                            auto triangle_texture = std::make_shared<barycentric_image_texture>(
-                                std::make_pair(u1,v1),
-                                std::make_pair(u2,v2),
-                                std::make_pair(u3,v3),
-                                capsule_texture
-                            );
-                            triangles.add(std::make_shared<triangle>(
-                                get_vertice_by_index(indices[3*i + 0].position_index), // first vertice
-                                get_vertice_by_index(indices[3*i + 1].position_index), // second vertice
-                                get_vertice_by_index(indices[3*i + 2].position_index), // third vertice
-                                std::make_shared<lambertian>(triangle_texture)));
-                        }
-                        else {
-                            triangles.add(std::make_shared<triangle>(
-                                get_vertice_by_index(indices[3*i + 0].position_index), // first vertice
-                                get_vertice_by_index(indices[3*i + 1].position_index), // second vertice
-                                get_vertice_by_index(indices[3*i + 2].position_index), // third vertice
-                                std::make_shared<lambertian>(color(Ka[0]+Kd[0], Ka[1]+Kd[1], Ka[2]+Kd[2]))));
-                        }
-                    }
-                    else {
-                        triangles.add(std::make_shared<triangle>(
-                            get_vertice_by_index(indices[3*i + 0].position_index), // first vertice
-                            get_vertice_by_index(indices[3*i + 1].position_index), // second vertice
-                            get_vertice_by_index(indices[3*i + 2].position_index), // third vertice
-                            std::make_shared<lambertian>(color::random())));
-                    }
+                    const auto& i0 = indices[3*i + 0];
+                    const auto& i1 = indices[3*i + 1];
+                    const auto& i2 = indices[3*i + 2];
+
+                    data.positions.push_back({to_index(i0.position_index), to_index(i1.position_index), to_index(i2.position_index)});
+                    data.normals.push_back({to_index(i0.normal_index), to_index(i1.normal_index), to_index(i2.normal_index)});
+                    data.texcoords.push_back({to_index(i0.texcoord_index), to_index(i1.texcoord_index), to_index(i2.texcoord_index)});
+
+                    if(!parse_data.materials.empty() && material_ids[i] >= 0)
+                        data.materials.push_back(static_cast<std::uint32_t>(material_ids[i]));
+                    else
+                        data.materials.push_back(palette_start + static_cast<std::uint32_t>(random_int(0, palette_size-1)));
                 }
             }
 
-            std::cout << "hittable list successfully built from mesh description (" << triangles.size() << " hittables)" << std::endl;
+            if (data.nx.empty())
+                data.normals.clear();
+            if (data.tu.empty())
+                data.texcoords.clear();
+
+            const auto triangle_count = data.positions.size();
+            const auto vertex_count = data.px.size();
+            auto triangles = std::make_shared<triangle_mesh>(std::move(data), std::move(materials));
+
+            std::cout << "triangle mesh successfully built from mesh description (" << triangle_count << " triangles, "
+                      << vertex_count << " vertices)" << std::endl;
             
             return triangles;
         }
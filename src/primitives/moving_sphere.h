@@ -2,62 +2,54 @@
 #define MOVING_SPHERE_H
 
 #include "hittable.h"
+#include "sphere.h"
 #include "vec3.h"
 
 class moving_sphere final : public hittable {
     public:
         moving_sphere(
-            point3 cen0, point3 cen1, double _time0, double _time1, double r, std::shared_ptr<material> m)
+            point3 cen0, point3 cen1, real _time0, real _time1, real r, std::shared_ptr<material> m)
             : center0(cen0), center1(cen1), time0(_time0), time1(_time1), radius(r), mat_ptr(m)
         {}
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override {
+            return hit_lanes(*this, packet, mask, t_min, t_max, rec);
+        }
     
         virtual bool bounding_box(
-            double _time0, double _time1, aabb& output_box) const override;
+            real _time0, real _time1, aabb& output_box) const override;
 
-        point3 center(double time) const;
+        point3 center(real time) const;
 
     public:
         point3 center0, center1;
-        double time0, time1;
-        double radius;
+        real time0, time1;
+        real radius;
         std::shared_ptr<material> mat_ptr;
 };
 
-point3 moving_sphere::center(double time) const {
+inline point3 moving_sphere::center(real time) const {
     return center0 + ((time - time0) / (time1 - time0))*(center1 - center0);
 }
 
-bool moving_sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-    vec3 oc = r.origin() - center(r.time());
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
-    auto c = oc.length_squared() - radius*radius;
-
-    auto discriminant = half_b*half_b - a*c;
-    if (discriminant < 0) return false;
-    auto sqrtd = std::sqrt(discriminant);
-
-    // Find the nearest root that lies in the acceptable range.
-    auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root)
-            return false;
-    }
+inline bool moving_sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+    real root;
+    if (!sphere::nearest_root(r.origin() - center(r.time()), r.direction(), radius, t_min, t_max, root))
+        return false;
 
     rec.t = root;
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
 
     return true;
 }
 
-bool moving_sphere::bounding_box(double _time0, double _time1, aabb& output_box) const {
+inline bool moving_sphere::bounding_box(real _time0, real _time1, aabb& output_box) const {
     aabb box0(
         center(_time0) - vec3(radius, radius, radius),
         center(_time0) + vec3(radius, radius, radius));
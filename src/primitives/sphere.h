@@ -1,27 +1,37 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
+#include "cpu_dispatch.h"
 #include "hittable.h"
 #include "vec3.h"
 
 class sphere final : public hittable {
     public:
-        sphere(point3 cen, double r, std::shared_ptr<material> m)
+        sphere(point3 cen, real r, std::shared_ptr<material> m)
             : center(cen), radius(r), mat_ptr(m) {}
 
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
-        virtual bool bounding_box(double time0, double time1, aabb& output_box) const override;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override {
+            return hit_lanes(*this, packet, mask, t_min, t_max, rec);
+        }
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+
+        // Nearest root within [t_min,t_max] of the ray (oc: origin minus
+        // center) with a sphere, shared with moving_sphere
+        static bool nearest_root(const vec3& oc, const vec3& direction, real radius,
+                                 real t_min, real t_max, real& root);
 
     private:
-        static void get_sphere_uv(const point3& p, double& u, double& v);
+        static void get_sphere_uv(const point3& p, real& u, real& v);
     
     private:
         point3 center;
-        double radius;
+        real radius;
         std::shared_ptr<material> mat_ptr;
 };
 
-void sphere::get_sphere_uv(const point3& p, double& u, double& v) {
+inline void sphere::get_sphere_uv(const point3& p, real& u, real& v) {
     // p: a given point on the sphere of radius one, centered at the origin.
     // u: returned value [0,1] of angle around the Y axis from X=-1.
     // v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -29,42 +39,34 @@ void sphere::get_sphere_uv(const point3& p, double& u, double& v) {
     //     <0 1 0> yields <0.50 1.00>       < 0 -1  0> yields <0.50 0.00>
     //     <0 0 1> yields <0.25 0.50>       < 0  0 -1> yields <0.75 0.50>
 
-    auto theta = acos(-p.y());
-    auto phi = atan2(-p.z(), p.x()) + pi;
+    auto theta = std::acos(-p.y());
+    auto phi = std::atan2(-p.z(), p.x()) + pi;
 
     u = phi / (2*pi);
     v = theta / pi;
 }
 
-bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-    vec3 oc = r.origin() - center;
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
-    auto c = oc.length_squared() - radius*radius;
-
-    auto discriminant = half_b*half_b - a*c;
-    if (discriminant < 0) return false;
-    auto sqrtd = std::sqrt(discriminant);
+inline bool sphere::nearest_root(const vec3& oc, const vec3& direction, real radius,
+                                 real t_min, real t_max, real& root) {
+    return cpu_dispatch::kernels().sphere_root(oc.e, direction.e, radius, t_min, t_max, root);
+}
 
-    // Find the nearest root that lies in the acceptable range.
-    auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root)
-            return false;
-    }
+inline bool sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+    real root;
+    if (!nearest_root(r.origin() - center, r.direction(), radius, t_min, t_max, root))
+        return false;
 
     rec.t = root;
     rec.p = r.at(rec.t);
     vec3 outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
     get_sphere_uv(outward_normal, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
     
     return true;
 }
 
-bool sphere::bounding_box(double time0, double time1, aabb& output_box) const {
+inline bool sphere::bounding_box(real time0, real time1, aabb& output_box) const {
     output_box = aabb(
         center - vec3(radius, radius, radius),
         center + vec3(radius, radius, radius));
@@ -0,0 +1,246 @@
+#include "triangle_mesh.h"
+
+#include "tracer_constants.h"
+
+#include <bit>
+
+namespace {
+
+template<typename T>
+std::vector<T> reorder(const std::vector<T>& values, const std::vector<std::uint32_t>& order) {
+    if (values.empty())
+        return {};
+    std::vector<T> ordered;
+    ordered.reserve(values.size());
+    for (auto index : order)
+        ordered.push_back(values[index]);
+    return ordered;
+}
+
+float l1_norm(const vec3& v) {
+    return static_cast<float>(std::fabs(v.x()) + std::fabs(v.y()) + std::fabs(v.z()));
+}
+
+} // namespace
+
+triangle_mesh::triangle_mesh(buffers _data, std::vector<std::shared_ptr<material>> _materials)
+    : data(std::move(_data)), materials(std::move(_materials))
+{
+    std::vector<aabb> boxes;
+    boxes.reserve(data.positions.size());
+    for (const auto& indices : data.positions) {
+        const auto p0 = _vertex(indices[0]);
+        const auto p1 = _vertex(indices[1]);
+        const auto p2 = _vertex(indices[2]);
+        boxes.emplace_back(min(p0,min(p1,p2)), max(p0,max(p1,p2)));
+    }
+
+    tree = linear_bvh(boxes);
+    if constexpr (tracer_constants::use_wide_bvh)
+        wide_tree = wide_bvh(tree);
+
+    // store the triangles in leaf order so that every leaf is a contiguous range
+    data.positions = reorder(data.positions, tree.primitive_order());
+    data.normals = reorder(data.normals, tree.primitive_order());
+    data.texcoords = reorder(data.texcoords, tree.primitive_order());
+    data.materials = reorder(data.materials, tree.primitive_order());
+
+    const auto padded_size = data.positions.size() + 3;
+    for (int a = 0; a < 3; ++a) {
+        lanes.v0[static_cast<size_t>(a)].reserve(padded_size);
+        lanes.e1[static_cast<size_t>(a)].reserve(padded_size);
+        lanes.e2[static_cast<size_t>(a)].reserve(padded_size);
+    }
+    triangles.reserve(data.positions.size());
+    for (const auto& indices : data.positions) {
+        const auto v0 = _vertex(indices[0]);
+        const auto e1 = _vertex(indices[1]) - v0;
+        const auto e2 = _vertex(indices[2]) - v0;
+        triangles.push_back({{v0.x(), v0.y(), v0.z()}, {e1.x(), e1.y(), e1.z()}, {e2.x(), e2.y(), e2.z()}});
+        for (int a = 0; a < 3; ++a) {
+            lanes.v0[static_cast<size_t>(a)].push_back(static_cast<float>(v0[a]));
+            lanes.e1[static_cast<size_t>(a)].push_back(static_cast<float>(e1[a]));
+            lanes.e2[static_cast<size_t>(a)].push_back(static_cast<float>(e2[a]));
+        }
+        lanes.v0_norm.push_back(l1_norm(v0));
+        lanes.edge_sum.push_back(l1_norm(e1) + l1_norm(e2));
+        lanes.edge_product.push_back(l1_norm(e1) * l1_norm(e2));
+    }
+    // padding lanes are masked out, they only need to be readable
+    for (int a = 0; a < 3; ++a) {
+        lanes.v0[static_cast<size_t>(a)].resize(padded_size, 0.0f);
+        lanes.e1[static_cast<size_t>(a)].resize(padded_size, 0.0f);
+        lanes.e2[static_cast<size_t>(a)].resize(padded_size, 0.0f);
+    }
+    lanes.v0_norm.resize(padded_size, 0.0f);
+    lanes.edge_sum.resize(padded_size, 0.0f);
+    lanes.edge_product.resize(padded_size, 0.0f);
+
+    std::cout << "triangle mesh bvh built over " << data.positions.size() << " triangles ("
+              << tree.node_array().size() << " nodes, " << tree.leaf_count() << " leaves, SAH cost "
+              << tree.sah_cost() << ")" << std::endl;
+}
+
+bool triangle_mesh::_intersect(std::uint32_t triangle, const ray& r, real t_min, real t_max,
+                               real& t, real& b1, real& b2) const {
+    // Möller-Trumbore: b1 and b2 are the barycentric weights of the second
+    // and third vertices.
+    const auto& tri = triangles[triangle];
+    const auto origin = r.origin();
+    const auto direction = r.direction();
+    return cpu_dispatch::kernels().triangle(origin.e, direction.e, tri.v0, tri.e1, tri.e2,
+                                            t_min, t_max, t, b1, b2);
+}
+
+triangle4_ray triangle_mesh::_ray_lanes(const ray& r) {
+    triangle4_ray rl;
+    for (int a = 0; a < 3; ++a) {
+        rl.origin[a] = static_cast<float>(r.origin()[a]);
+        rl.direction[a] = static_cast<float>(r.direction()[a]);
+    }
+    rl.origin_norm = l1_norm(r.origin());
+    rl.direction_norm = l1_norm(r.direction());
+    return rl;
+}
+
+triangle4_arrays triangle_mesh::_lane_arrays() const {
+    triangle4_arrays arrays;
+    for (size_t a = 0; a < 3; ++a) {
+        arrays.v0[a] = lanes.v0[a].data();
+        arrays.e1[a] = lanes.e1[a].data();
+        arrays.e2[a] = lanes.e2[a].data();
+    }
+    arrays.v0_norm = lanes.v0_norm.data();
+    arrays.edge_sum = lanes.edge_sum.data();
+    arrays.edge_product = lanes.edge_product.data();
+    return arrays;
+}
+
+void triangle_mesh::_shade(std::uint32_t triangle, real b1, real b2, const ray& r, hit_record& rec) const {
+    const auto b0 = 1 - b1 - b2;
+    const auto& indices = data.positions[triangle];
+    const auto p0 = _vertex(indices[0]);
+    const auto p1 = _vertex(indices[1]);
+    const auto p2 = _vertex(indices[2]);
+
+    rec.p = r.at(rec.t);
+
+    vec3 outward_normal = cross(p1 - p0, p2 - p0);
+    if (!data.normals.empty() && data.normals[triangle][0] != no_index) {
+        const auto& n = data.normals[triangle];
+        outward_normal = b0 * vec3(data.nx[n[0]], data.ny[n[0]], data.nz[n[0]])
+                       + b1 * vec3(data.nx[n[1]], data.ny[n[1]], data.nz[n[1]])
+                       + b2 * vec3(data.nx[n[2]], data.ny[n[2]], data.nz[n[2]]);
+    }
+    rec.set_face_normal(r, unit_vector(outward_normal));
+
+    if (!data.texcoords.empty() && data.texcoords[triangle][0] != no_index) {
+        const auto& uv = data.texcoords[triangle];
+        rec.u = b0 * data.tu[uv[0]] + b1 * data.tu[uv[1]] + b2 * data.tu[uv[2]];
+        rec.v = b0 * data.tv[uv[0]] + b1 * data.tv[uv[1]] + b2 * data.tv[uv[2]];
+    }
+    else {
+        // barycentric coordinates, as for the triangle primitive
+        rec.u = b0;
+        rec.v = b1;
+    }
+
+    rec.mat_ptr = materials[data.materials[triangle]].get();
+}
+
+bool triangle_mesh::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+    std::uint32_t closest = no_index;
+    real closest_b1 = 0.0, closest_b2 = 0.0;
+
+    const auto rl = _ray_lanes(r);
+    const auto arrays = _lane_arrays();
+    const auto& kernels = cpu_dispatch::kernels();
+
+    // whole leaves are filtered at once, candidates being confirmed in
+    // full precision so that the result matches the scalar test
+    const auto intersect = [&](std::uint32_t first, std::uint32_t count, const ray& r, real t_min, real t_max, hit_record& rec) {
+        bool hit_anything = false;
+        auto candidates = static_cast<unsigned>(kernels.triangle4(arrays, first, count, rl, static_cast<float>(t_max)));
+        while (candidates != 0) {
+            const auto i = first + static_cast<std::uint32_t>(std::countr_zero(candidates));
+            candidates &= candidates - 1;
+            real t, b1, b2;
+            if (!_intersect(i, r, t_min, t_max, t, b1, b2))
+                continue;
+            t_max = rec.t = t;
+            closest = i;
+            closest_b1 = b1;
+            closest_b2 = b2;
+            hit_anything = true;
+        }
+        return hit_anything;
+    };
+
+    bool hit_anything = false;
+    if constexpr (tracer_constants::use_wide_bvh)
+        hit_anything = wide_tree.hit(r, t_min, t_max, rec, intersect);
+    else
+        hit_anything = tree.hit(r, t_min, t_max, rec, intersect);
+
+    if (!hit_anything)
+        return false;
+
+    // shading attributes are only interpolated for the closest hit
+    _shade(closest, closest_b1, closest_b2, r, rec);
+    return true;
+}
+
+int triangle_mesh::hit_packet(const ray_packet& packet, int mask, real t_min,
+                              packet_distances& t_max, packet_records& rec) const {
+    std::array<triangle4_ray,ray_packet::size> rl;
+    std::array<std::uint32_t,ray_packet::size> closest;
+    std::array<real,ray_packet::size> closest_b1, closest_b2;
+    for (auto lanes = static_cast<unsigned>(mask); lanes != 0; lanes &= lanes - 1) {
+        const auto k = static_cast<size_t>(std::countr_zero(lanes));
+        rl[k] = _ray_lanes(packet.rays[k]);
+        closest[k] = no_index;
+    }
+
+    const auto arrays = _lane_arrays();
+    const auto& kernels = cpu_dispatch::kernels();
+
+    // the leaf filter of hit, run for every lane reaching the leaf
+    const auto intersect = [&](std::uint32_t first, std::uint32_t count, int lanes, real t_min,
+                               packet_distances& t_max, packet_records&) {
+        count_traversal(&path_statistics::hittable_tests,
+                        count*static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(lanes))));
+        int hits = 0;
+        for (auto remaining = static_cast<unsigned>(lanes); remaining != 0; remaining &= remaining - 1) {
+            const auto lane = std::countr_zero(remaining);
+            const auto k = static_cast<size_t>(lane);
+            auto candidates = static_cast<unsigned>(kernels.triangle4(arrays, first, count, rl[k], static_cast<float>(t_max[k])));
+            while (candidates != 0) {
+                const auto i = first + static_cast<std::uint32_t>(std::countr_zero(candidates));
+                candidates &= candidates - 1;
+                real t, b1, b2;
+                if (!_intersect(i, packet.rays[k], t_min, t_max[k], t, b1, b2))
+                    continue;
+                t_max[k] = t;
+                closest[k] = i;
+                closest_b1[k] = b1;
+                closest_b2[k] = b2;
+                hits |= 1 << lane;
+            }
+        }
+        count_traversal(&path_statistics::hittable_hits, static_cast<std::uint64_t>(std::popcount(static_cast<unsigned>(hits))));
+        return hits;
+    };
+
+    const int hits = tree.hit_packet(packet, mask, t_min, t_max, rec, intersect);
+    for (auto lanes = static_cast<unsigned>(hits); lanes != 0; lanes &= lanes - 1) {
+        const auto k = static_cast<size_t>(std::countr_zero(lanes));
+        rec[k].t = t_max[k];
+        _shade(closest[k], closest_b1[k], closest_b2[k], packet.rays[k], rec[k]);
+    }
+    return hits;
+}
+
+bool triangle_mesh::bounding_box(real time0, real time1, aabb& output_box) const {
+    output_box = tree.bounds();
+    return !tree.empty();
+}
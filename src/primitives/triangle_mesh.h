@@ -0,0 +1,85 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "tracer_utils.h"
+
+#include "cpu_dispatch.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle mesh: vertex attributes live in shared structure of arrays
+// buffers, triangles only store indices, and the mesh owns the BVH over its
+// triangles so that a single hittable covers the whole model.
+class triangle_mesh final : public hittable {
+    public:
+        static constexpr std::uint32_t no_index = 0xffffffffu;
+
+        using triangle_indices = std::array<std::uint32_t,3>;
+
+        struct buffers {
+            std::vector<float> px, py, pz;                  // vertex positions
+            std::vector<float> nx, ny, nz;                  // vertex normals (optional)
+            std::vector<float> tu, tv;                      // texture coordinates (optional)
+            std::vector<triangle_indices> positions;        // per triangle position indices
+            std::vector<triangle_indices> normals;          // per triangle normal indices, no_index if missing
+            std::vector<triangle_indices> texcoords;        // per triangle texcoord indices, no_index if missing
+            std::vector<std::uint32_t> materials;           // per triangle index in the material table
+        };
+
+        triangle_mesh(buffers _data, std::vector<std::shared_ptr<material>> _materials);
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+        virtual int hit_packet(const ray_packet& packet, int mask, real t_min,
+                               packet_distances& t_max, packet_records& rec) const override;
+        virtual bool bounding_box(real time0, real time1, aabb& output_box) const override;
+
+        size_t size() const { return data.positions.size(); }
+
+    private:
+        // Möller-Trumbore data precomputed once per triangle, in leaf order,
+        // unpadded: the triangle kernel reads three coordinates per vector
+        struct precomputed_triangle {
+            real v0[3];
+            real e1[3];    // v1 - v0
+            real e2[3];    // v2 - v0
+        };
+
+        // Single precision copy of the precomputed data, one array per
+        // component and padded so that any leaf loads as four lanes, plus the
+        // L1 norms bounding the rounding errors of the batched test (the
+        // triangle4 kernel, which filters the leaves before _intersect).
+        struct triangle_lanes {
+            std::array<std::vector<float>,3> v0, e1, e2;
+            std::vector<float> v0_norm;         // |v0|
+            std::vector<float> edge_sum;        // |e1| + |e2|
+            std::vector<float> edge_product;    // |e1| * |e2|
+        };
+
+        point3 _vertex(std::uint32_t index) const {
+            return point3(data.px[index], data.py[index], data.pz[index]);
+        }
+
+        static triangle4_ray _ray_lanes(const ray& r);
+        triangle4_arrays _lane_arrays() const;
+
+        // Hit point, normal, texture coordinates and material of a hit triangle, rec.t being set
+        void _shade(std::uint32_t triangle, real b1, real b2, const ray& r, hit_record& rec) const;
+
+        bool _intersect(std::uint32_t triangle, const ray& r, real t_min, real t_max,
+                        real& t, real& b1, real& b2) const;
+
+    private:
+        buffers data;                                       // triangles in BVH leaf order
+        std::vector<precomputed_triangle> triangles;
+        triangle_lanes lanes;
+        std::vector<std::shared_ptr<material>> materials;   // material table
+        linear_bvh tree;
+        wide_bvh wide_tree;
+};
+
+#endif
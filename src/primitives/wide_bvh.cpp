@@ -0,0 +1,82 @@
+#include "wide_bvh.h"
+
+#include "trace.h"
+
+#include <limits>
+
+namespace {
+
+double surface_area(const linear_bvh_node& node) {
+    const double dx = node.bounds_max[0] - node.bounds_min[0];
+    const double dy = node.bounds_max[1] - node.bounds_min[1];
+    const double dz = node.bounds_max[2] - node.bounds_min[2];
+    return 2.0*(dx*dy + dy*dz + dz*dx);
+}
+
+} // namespace
+
+wide_bvh::wide_bvh(const linear_bvh& binary) {
+    if (binary.empty())
+        return;
+
+    scoped_trace trace("wide bvh collapse", "scene");
+    const auto start = std::chrono::steady_clock::now();
+
+    nodes.reserve(binary.node_array().size()/2 + 1);
+    _collapse(binary.node_array(), 0);
+
+    linear_bvh::add_build_time(std::chrono::steady_clock::now() - start);
+}
+
+std::uint32_t wide_bvh::_collapse(const std::vector<linear_bvh_node>& binary, std::uint32_t root) {
+    // open the largest interior binary node until four children are gathered
+    std::array<std::uint32_t,4> slots{root};
+    size_t slot_count = 1;
+    while (slot_count < static_cast<size_t>(width)) {
+        int largest = -1;
+        double largest_area = -1.0;
+        for (size_t k = 0; k < slot_count; ++k) {
+            const auto& node = binary[slots[k]];
+            if (node.count == 0 && surface_area(node) > largest_area) {
+                largest = static_cast<int>(k);
+                largest_area = surface_area(node);
+            }
+        }
+        if (largest < 0)
+            break;
+
+        const auto opened = slots[static_cast<size_t>(largest)];
+        slots[static_cast<size_t>(largest)] = opened + 1;
+        slots[slot_count++] = binary[opened].offset;
+    }
+
+    const auto index = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    for (size_t a = 0; a < 3; ++a) {
+        for (size_t c = 0; c < 4; ++c) {
+            nodes[index].bounds_min[a][c] = std::numeric_limits<float>::infinity();
+            nodes[index].bounds_max[a][c] = -std::numeric_limits<float>::infinity();
+        }
+    }
+    for (size_t c = 0; c < 4; ++c) {
+        nodes[index].child[c] = 0;
+        nodes[index].count[c] = 0;
+    }
+
+    for (size_t c = 0; c < slot_count; ++c) {
+        const auto& child = binary[slots[c]];
+        std::uint32_t child_index = child.offset;
+        if (child.count == 0)
+            child_index = _collapse(binary, slots[c]); // may reallocate nodes
+
+        auto& node = nodes[index];
+        for (size_t a = 0; a < 3; ++a) {
+            node.bounds_min[a][c] = child.bounds_min[a];
+            node.bounds_max[a][c] = child.bounds_max[a];
+        }
+        node.child[c] = child_index;
+        node.count[c] = child.count;
+    }
+
+    return index;
+}
@@ -0,0 +1,139 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "tracer_utils.h"
+
+#include "cpu_dispatch.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// 4-wide BVH node: the bounds of the four children are stored axis by axis
+// (structure of arrays) so that a single SIMD slab test covers all of them.
+// Unused slots have empty (inverted) bounds and are never hit.
+struct alignas(64) wide_bvh_node {
+    float bounds_min[3][4];
+    float bounds_max[3][4];
+    std::uint32_t child[4];     // interior child: wide node index / leaf child: first primitive
+    std::uint16_t count[4];     // 0 for interior children, number of primitives for leaves
+};
+
+// BVH4 collapsed from a binary linear_bvh: every wide node absorbs up to two
+// levels of the binary tree, largest children being opened first. Leaves and
+// primitive indices are shared with the source tree.
+class wide_bvh {
+    public:
+        wide_bvh() = default;
+        explicit wide_bvh(const linear_bvh& binary);
+
+        // Same contract as linear_bvh::hit
+        template<typename Intersector>
+        bool hit(const ray& r, real t_min, real t_max, hit_record& rec, Intersector&& intersect) const;
+
+        const std::vector<wide_bvh_node>& node_array() const { return nodes; }
+        bool empty() const { return nodes.empty(); }
+
+    public:
+        static constexpr int width = 4;
+        static constexpr size_t max_stack_depth = 512;
+
+    private:
+        std::uint32_t _collapse(const std::vector<linear_bvh_node>& binary, std::uint32_t root);
+
+    private:
+        std::vector<wide_bvh_node> nodes;
+};
+
+template<typename Intersector>
+bool wide_bvh::hit(const ray& r, real t_min, real t_max, hit_record& rec, Intersector&& intersect) const {
+    if (nodes.empty())
+        return false;
+
+    // Per ray precomputation: inverse direction, and origins nudged by one ulp
+    // towards the near and far planes to cover the double to float rounding.
+    box4_ray slab_ray;
+    for (int a = 0; a < 3; ++a) {
+        const auto inv = static_cast<float>(1.0/r.direction()[a]);
+        const auto o = static_cast<float>(r.origin()[a]);
+        const auto delta = std::fabs(o)*0x1p-23f;
+        slab_ray.dir_is_neg[a] = inv < 0.0f;
+        for (int k = 0; k < width; ++k) {
+            slab_ray.origin[a][k] = inv < 0.0f ? o - delta : o + delta;
+            slab_ray.origin[a][width + k] = inv < 0.0f ? o + delta : o - delta;
+            slab_ray.inv_dir[a][k] = inv;
+            slab_ray.inv_dir[a][width + k] = -inv;
+        }
+    }
+    const auto box4 = cpu_dispatch::kernels().box4;
+
+    struct stack_entry {
+        std::uint32_t index;
+        std::uint16_t count;   // 0 for wide nodes, number of primitives for leaves
+        float t;               // entry distance in the parent slab test
+    };
+
+    std::array<stack_entry,max_stack_depth> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, 0, static_cast<float>(t_min)};
+
+    const auto t_min_f = static_cast<float>(t_min);
+    auto t_max_f = static_cast<float>(t_max)*box4_far_scale;
+    bool hit_anything = false;
+    std::uint64_t visited = 0;
+
+    while (stack_size > 0) {
+        const auto entry = stack[--stack_size];
+        if (entry.t > t_max_f)
+            continue; // farther than the closest hit found so far
+
+        const auto& node = nodes[entry.index];
+        ++visited;
+        float near_lanes[width];
+        const int mask = box4(node.bounds_min[0], node.bounds_max[0], slab_ray, t_min_f, t_max_f, near_lanes);
+        if (mask == 0)
+            continue;
+
+        // sort the children hit by entry distance, nearest first
+        std::array<stack_entry,4> hits;
+        size_t hit_count = 0;
+        for (int c = 0; c < width; ++c) {
+            if (!(mask & (1 << c)))
+                continue;
+            stack_entry e{node.child[c], node.count[c], near_lanes[c]};
+            auto k = hit_count++;
+            for (; k > 0 && hits[k-1].t > e.t; --k)
+                hits[k] = hits[k-1];
+            hits[k] = e;
+        }
+
+        // leaves are intersected right away, nearest first, which shrinks
+        // t_max before the remaining nodes get popped
+        size_t node_count = 0;
+        for (size_t k = 0; k < hit_count; ++k) {
+            const auto& e = hits[k];
+            if (e.count == 0) {
+                hits[node_count++] = e;
+                continue;
+            }
+            if (e.t > t_max_f)
+                continue;
+            if (intersect_leaf(intersect, e.index, e.count, r, t_min, t_max, rec)) {
+                hit_anything = true;
+                t_max_f = static_cast<float>(t_max)*box4_far_scale;
+            }
+        }
+
+        // push the nodes farthest first, so that the nearest one is popped first
+        while (node_count > 0)
+            stack[stack_size++] = hits[--node_count];
+    }
+
+    count_traversal(&path_statistics::bvh_queries);
+    count_traversal(&path_statistics::nodes_visited, visited);
+    return hit_anything;
+}
+
+#endif
@@ -5,35 +5,36 @@
 #include "texture.h"
 #include "tracer_utils.h"
 
-struct hit_record;
+// shading groups of the wavefront engine
+enum class material_kind { lambertian, metal, dielectric, diffuse_light, isotropic, count };
 
 class material {
     public:
-        virtual color emitted(double u, double v, const point3& p) const {
+        explicit material(material_kind k) : kind(k) {}
+
+        virtual color emitted(real u, real v, const point3& p) const {
             return color(0,0,0);
         }
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const = 0;
+
+    public:
+        const material_kind kind;
 };
 
 class lambertian final : public material {
     public:
-        explicit lambertian(const color& a) : albedo(std::make_shared<solid_color>(a)) {}
-        explicit lambertian(std::shared_ptr<texture> a) : albedo(a) {}
+        explicit lambertian(const color& a) : material(material_kind::lambertian), albedo(std::make_shared<solid_color>(a)) {}
+        explicit lambertian(std::shared_ptr<texture> a) : material(material_kind::lambertian), albedo(a) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
-            //auto scatter_direction = rec.normal + random_in_unit_sphere();
-            auto scatter_direction = rec.normal + random_unit_vector();
-            //auto scatter_direction = random_in_hemisphere(rec.normal);
-            
-            // Catch degenerate scatter direction
-            if (scatter_direction.near_zero())
-                scatter_direction = rec.normal;
-            
-            scattered = ray(rec.p, scatter_direction, r_in.time());
+            // cosine weighted, as rec.normal + random_unit_vector() but never degenerate
+            const auto [u1, u2] = next_sample_2d();
+            const auto scatter_direction = sample_cosine_hemisphere(rec.normal, u1, u2);
+            scattered = ray(rec.spawn_origin(scatter_direction), scatter_direction, r_in.time());
             attenuation = albedo->value(rec.u, rec.v, rec.p);
             return true;
         }
@@ -44,64 +45,67 @@ class lambertian final : public material {
 
 class metal final : public material {
     public:
-        metal(const color& a, double f) : albedo(a), fuzz(f < 1. ? f : 1.) {}
+        metal(const color& a, real f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
             vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-            scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere(), r_in.time());
+            const auto [u1, u2] = next_sample_2d();
+            const auto u3 = next_sample_1d();
+            const auto direction = reflected + fuzz*sample_uniform_ball(u1, u2, u3);
+            scattered = ray(rec.spawn_origin(direction), direction, r_in.time());
             attenuation = albedo;
             return (dot(scattered.direction(), rec.normal) > 0);
         }
 
     public:
         color albedo;
-        double fuzz;
+        real fuzz;
 };
 
 class dielectric final : public material {
     public:
-        explicit dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+        explicit dielectric(real index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
             attenuation = color(1.0, 1.0, 1.0);
-            double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
+            real refraction_ratio = rec.front_face ? (1/ir) : ir;
 
             vec3 unit_direction = unit_vector(r_in.direction());
-            double cos_theta = std::min(dot(-unit_direction, rec.normal), 1.0);
-            double sin_theta = std::sqrt(1.0 - cos_theta*cos_theta);
+            real cos_theta = std::min(dot(-unit_direction, rec.normal), real(1));
+            real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
 
             bool cannot_refract = refraction_ratio * sin_theta > 1.0;
             vec3 direction;
 
-            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > next_sample_1d())
                 direction = reflect(unit_direction, rec.normal);
             else
                 direction = refract(unit_direction, rec.normal, refraction_ratio);
 
-            scattered = ray(rec.p, direction, r_in.time());
+            scattered = ray(rec.spawn_origin(direction), direction, r_in.time());
             return true;
         }
 
     private:
-        double ir; // Index of Refraction
+        real ir; // Index of Refraction
     
     private:
-        static double reflectance(double cosine, double ref_idx) {
+        static real reflectance(real cosine, real ref_idx) {
             // Use Schlick's approximation for reflectance.
             auto r0 = (1-ref_idx) / (1+ref_idx);
             r0 = r0*r0;
-            return r0 + (1-r0)*pow((1 - cosine),5);
+            return r0 + (1-r0)*std::pow((1 - cosine),real(5));
         }
 };
 
 class diffuse_light final : public material  {
     public:
-        explicit diffuse_light(std::shared_ptr<texture> a) : emit(a) {}
-        explicit diffuse_light(color c) : emit(std::make_shared<solid_color>(c)) {}
+        explicit diffuse_light(std::shared_ptr<texture> a) : material(material_kind::diffuse_light), emit(a) {}
+        explicit diffuse_light(color c) : material(material_kind::diffuse_light), emit(std::make_shared<solid_color>(c)) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
@@ -109,7 +113,7 @@ class diffuse_light final : public material  {
             return false;
         }
 
-        virtual color emitted(double u, double v, const point3& p) const override {
+        virtual color emitted(real u, real v, const point3& p) const override {
             return emit->value(u, v, p);
         }
 
@@ -119,13 +123,14 @@ class diffuse_light final : public material  {
 
 class isotropic final : public material {
     public:
-        explicit isotropic(color c) : albedo(std::make_shared<solid_color>(c)) {}
-        explicit isotropic(std::shared_ptr<texture> a) : albedo(a) {}
+        explicit isotropic(color c) : material(material_kind::isotropic), albedo(std::make_shared<solid_color>(c)) {}
+        explicit isotropic(std::shared_ptr<texture> a) : material(material_kind::isotropic), albedo(a) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
-            scattered = ray(rec.p, random_in_unit_sphere(), r_in.time());
+            const auto [u1, u2] = next_sample_2d();
+            scattered = ray(rec.p, sample_uniform_sphere(u1, u2), r_in.time());
             attenuation = albedo->value(rec.u, rec.v, rec.p);
             return true;
         }
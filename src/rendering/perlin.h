@@ -18,13 +18,13 @@ class perlin {
             perlin_generate_perm(perm_z.data());
         }
 
-        double noise(const point3& p) const {
-            auto u = p.x() - floor(p.x());
-            auto v = p.y() - floor(p.y());
-            auto w = p.z() - floor(p.z());
-            auto i = static_cast<int>(floor(p.x()));
-            auto j = static_cast<int>(floor(p.y()));
-            auto k = static_cast<int>(floor(p.z()));
+        real noise(const point3& p) const {
+            auto u = p.x() - std::floor(p.x());
+            auto v = p.y() - std::floor(p.y());
+            auto w = p.z() - std::floor(p.z());
+            auto i = static_cast<int>(std::floor(p.x()));
+            auto j = static_cast<int>(std::floor(p.y()));
+            auto k = static_cast<int>(std::floor(p.z()));
             vec3 c[2][2][2];
 
             for (int di=0; di < 2; di++)
@@ -39,14 +39,14 @@ class perlin {
             return perlin_interp(c, u, v, w);
         }
     
-        double turb(const point3& p, int depth=7) const {
-            auto accum = 0.0;
+        real turb(const point3& p, int depth=7) const {
+            real accum = 0;
             auto temp_p = p;
-            auto weight = 1.0;
+            real weight = 1;
 
             for (int i = 0; i < depth; i++) {
                 accum += weight*noise(temp_p);
-                weight *= 0.5;
+                weight *= real(0.5);
                 temp_p *= 2;
             }
 
@@ -76,19 +76,19 @@ class perlin {
             }
         }
     
-        static double perlin_interp(vec3 c[2][2][2], double u, double v, double w) {
+        static real perlin_interp(vec3 c[2][2][2], real u, real v, real w) {
             auto uu = u*u*(3-2*u);
             auto vv = v*v*(3-2*v);
             auto ww = w*w*(3-2*w);
-            auto accum = 0.0;
+            real accum = 0;
 
             for (int i=0; i < 2; i++)
                 for (int j=0; j < 2; j++)
                     for (int k=0; k < 2; k++) {
-                        vec3 weight_v(u-i, v-j, w-k);
-                        accum += (i*uu + (1-i)*(1-uu))
-                               * (j*vv + (1-j)*(1-vv))
-                               * (k*ww + (1-k)*(1-ww))
+                        vec3 weight_v(u-real(i), v-real(j), w-real(k));
+                        accum += (real(i)*uu + real(1-i)*(1-uu))
+                               * (real(j)*vv + real(1-j)*(1-vv))
+                               * (real(k)*ww + real(1-k)*(1-ww))
                                * dot(c[i][j][k], weight_v);
                     }
 
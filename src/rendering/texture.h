@@ -10,17 +10,17 @@
 
 class texture {
     public:
-        virtual color value(double u, double v, const point3& p) const = 0;
+        virtual color value(real u, real v, const point3& p) const = 0;
 };
 
 class solid_color final : public texture {
     public:
         solid_color(color c) : color_value(c) {}
 
-        solid_color(double red, double green, double blue)
+        solid_color(real red, real green, real blue)
           : solid_color(color(red,green,blue)) {}
 
-        virtual color value(double u, double v, const vec3& p) const override {
+        virtual color value(real u, real v, const vec3& p) const override {
             return color_value;
         }
 
@@ -36,7 +36,7 @@ class checker_texture final : public texture {
         checker_texture(color c1, color c2)
             : even(std::make_shared<solid_color>(c1)) , odd(std::make_shared<solid_color>(c2)) {}
 
-        virtual color value(double u, double v, const point3& p) const override {
+        virtual color value(real u, real v, const point3& p) const override {
             auto sines = sin(10*p.x())*sin(10*p.y())*sin(10*p.z());
             if (sines < 0)
                 return odd->value(u, v, p);
@@ -52,16 +52,16 @@ class checker_texture final : public texture {
 class noise_texture final : public texture {
     public:
 
-        noise_texture(double sc) : scale(sc) {}
+        noise_texture(real sc) : scale(sc) {}
 
-        virtual color value(double u, double v, const point3& p) const override {
+        virtual color value(real u, real v, const point3& p) const override {
             return color(1,1,1) * 0.5 * (1.0 + noise.noise(scale * p));
             //return color(1,1,1) * 0.5 * (1 + sin(scale*p.z() + 10*noise.turb(p)));
         }
 
     public:
         perlin noise;
-        double scale;
+        real scale;
 };
 
 class image_texture final : public texture {
@@ -85,18 +85,18 @@ class image_texture final : public texture {
             //gui::display( data.get(), width, height );
         }
 
-        virtual color value(double u, double v, const point3& p) const override {
+        virtual color value(real u, real v, const point3& p) const override {
             
             // If we have no texture data, then return solid cyan as a debugging aid.
             if (data == nullptr)
                 return color(0,1,1);
             
             // Clamp input texture coordinates to [0,1] x [1,0]
-            u = clamp(u, 0.0, 1.0);
-            v = 1.0 - clamp(v, 0.0, 1.0);  // Flip V to image coordinates
+            u = static_cast<real>(clamp(u, 0.0, 1.0));
+            v = static_cast<real>(1.0 - clamp(v, 0.0, 1.0));  // Flip V to image coordinates
 
-            auto i = static_cast<int>(u * width);
-            auto j = static_cast<int>(v * height);
+            auto i = static_cast<int>(u * static_cast<real>(width));
+            auto j = static_cast<int>(v * static_cast<real>(height));
 
             // Clamp integer mapping, since actual coordinates should be less than 1.0
             if (i >= width)  i = width-1;
@@ -122,7 +122,7 @@ class barycentric_texture final : public texture {
     public:
         barycentric_texture(color a, color b, color c) : color_a(a), color_b(b), color_c(c) {}
 
-        virtual color value(double u, double v, const vec3& p) const override {
+        virtual color value(real u, real v, const vec3& p) const override {
             return u*color_a + v*color_b + (1.0-u-v)*color_c;
         }
 
@@ -134,11 +134,11 @@ class barycentric_texture final : public texture {
 
 class barycentric_image_texture final : public texture {
     public:
-        using uv = std::pair<double,double>;
+        using uv = std::pair<real,real>;
         barycentric_image_texture(uv a, uv b, uv c, std::shared_ptr<image_texture> _tex) 
             : texcoord_a(a), texcoord_b(b), texcoord_c(c), tex(_tex) {}
 
-        virtual color value(double u, double v, const vec3& p) const override {
+        virtual color value(real u, real v, const vec3& p) const override {
             return tex->value(
                 u * texcoord_a.first + v * texcoord_b.first + (1-u-v) * texcoord_c.first,
                 u * texcoord_a.second + v * texcoord_b.second + (1-u-v) * texcoord_c.second,
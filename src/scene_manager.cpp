@@ -9,6 +9,7 @@
 #include "moving_sphere.h"
 #include "ressources.h"
 #include "sphere.h"
+#include "trace.h"
 
 hittable_list scene_manager::_random_scene()
 {
@@ -19,8 +20,8 @@ hittable_list scene_manager::_random_scene()
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+            auto choose_mat = random_real();
+            point3 center(a + 0.9*random_real(), 0.2, b + 0.9*random_real());
 
             if ((center - point3(4, 0.2, 0)).length() > 0.9) {
                 std::shared_ptr<material> sphere_material;
@@ -30,13 +31,13 @@ hittable_list scene_manager::_random_scene()
                     auto albedo = color::random() * color::random();
                     sphere_material = std::make_shared<lambertian>(albedo);
                     objects.add(std::make_shared<sphere>(center, 0.2, sphere_material));
-                    auto center2 = center + vec3(0, random_double(0,.5), 0);
+                    auto center2 = center + vec3(0, random_real(0,.5), 0);
                     objects.add(std::make_shared<moving_sphere>(
                         center, center2, 0.0, 1.0, 0.2, sphere_material));
                 } else if (choose_mat < 0.95) {
                     // metal
                     auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
+                    auto fuzz = random_real(0, 0.5);
                     sphere_material = std::make_shared<metal>(albedo, fuzz);
                     objects.add(std::make_shared<sphere>(center, 0.2, sphere_material));
                 } else {
@@ -181,7 +182,7 @@ hittable_list scene_manager::_final_scene()
             auto z0 = -1000.0 + j*w;
             auto y0 = 0.0;
             auto x1 = x0 + w;
-            auto y1 = random_double(1,101);
+            auto y1 = random_real(1,101);
             auto z1 = z0 + w;
 
             boxes1.add(std::make_shared<box>(point3(x0,y0,z0), point3(x1,y1,z1), ground));
@@ -239,9 +240,8 @@ hittable_list scene_manager::_mesh_scene()
     if( m.parse(ressources::capsule_obj_path) ) {
         hittable_list world;
         
-        // mesh triangles
-        auto triangles = m.build();
-        world.add(std::make_shared<bvh_node>(triangles, 0.0, 1.0));
+        // mesh triangles, the mesh carries its own bvh
+        world.add(m.build());
         
         // lighting
         auto light = std::make_shared<diffuse_light>(color(7, 7, 7));
@@ -259,6 +259,8 @@ hittable_list scene_manager::_mesh_scene()
 
 scene scene_manager::build( scene_alias alias )
 {
+    scoped_trace trace("scene build", "scene");
+
     scene world;
 
     switch (alias) {
@@ -0,0 +1,128 @@
+#include "cpu_dispatch.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <immintrin.h>
+    #include <intrin.h>
+#endif
+
+// Constant initialized, so that the kernels are usable before the selection
+const kernel_table* cpu_dispatch::s_kernels = &baseline_kernels;
+
+namespace
+{
+    // the variant is selected before main
+    [[maybe_unused]] const cpu_dispatch& startup_dispatch = cpu_dispatch::instance();
+}
+
+cpu_dispatch& cpu_dispatch::instance()
+{
+    static cpu_dispatch dispatch;
+    return dispatch;
+}
+
+cpu_dispatch::cpu_dispatch()
+{
+    for( auto isa : { cpu_isa::avx2, cpu_isa::avx512 } )
+    {
+        if( available( isa ) )
+            m_detected = isa;
+    }
+    force( m_detected );
+
+    if( const char* forced = std::getenv( "RAYTRACER_ISA" ) )
+    {
+        cpu_isa isa;
+        if( !parse( forced, isa ) )
+            std::cerr << "RAYTRACER_ISA: unknown instruction set '" << forced << "', using " << name( m_active ) << std::endl;
+        else if( !force( isa ) )
+            std::cerr << "RAYTRACER_ISA: " << name( isa ) << " kernels are not available, using " << name( m_active ) << std::endl;
+    }
+}
+
+bool cpu_dispatch::available( cpu_isa isa ) const
+{
+    return table( isa ) != nullptr && host_supports( isa );
+}
+
+bool cpu_dispatch::force( cpu_isa isa )
+{
+    if( !available( isa ) )
+        return false;
+    m_active = isa;
+    s_kernels = table( isa );
+    return true;
+}
+
+const char* cpu_dispatch::name( cpu_isa isa )
+{
+    switch( isa )
+    {
+        case cpu_isa::baseline: return "baseline";
+        case cpu_isa::avx2:     return "avx2";
+        case cpu_isa::avx512:   return "avx512";
+    }
+    return "unknown";
+}
+
+bool cpu_dispatch::parse( const std::string& name, cpu_isa& isa )
+{
+    for( auto candidate : { cpu_isa::baseline, cpu_isa::avx2, cpu_isa::avx512 } )
+    {
+        if( name == cpu_dispatch::name( candidate ) )
+        {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const kernel_table* cpu_dispatch::table( cpu_isa isa )
+{
+    // the AVX variants are only built for x86 targets (see CMakeLists.txt)
+    switch( isa )
+    {
+        case cpu_isa::baseline: return &baseline_kernels;
+#ifdef TRACER_KERNELS_AVX
+        case cpu_isa::avx2:     return &avx2_kernels;
+        case cpu_isa::avx512:   return &avx512_kernels;
+#endif
+        default:                return nullptr;
+    }
+}
+
+bool cpu_dispatch::host_supports( cpu_isa isa )
+{
+    if( isa == cpu_isa::baseline )
+        return true;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // the builtins also check that the OS saves the AVX registers
+    __builtin_cpu_init();
+    if( isa == cpu_isa::avx2 )
+        return __builtin_cpu_supports( "avx2" );
+    return __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512vl" )
+        && __builtin_cpu_supports( "avx512dq" ) && __builtin_cpu_supports( "avx512bw" );
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int leaf1[4], leaf7[4];
+    __cpuid( leaf1, 1 );
+    __cpuidex( leaf7, 7, 0 );
+    const auto bit = []( int reg, int b ) { return ( reg >> b & 1 ) != 0; };
+
+    // OSXSAVE, then the register states enabled by the OS in XCR0
+    if( !bit( leaf1[2], 27 ) )
+        return false;
+    const auto xcr0 = _xgetbv( 0 );
+    const bool avx_state = ( xcr0 & 0x6 ) == 0x6;
+    const bool avx512_state = ( xcr0 & 0xe6 ) == 0xe6;
+
+    if( isa == cpu_isa::avx2 )
+        return avx_state && bit( leaf7[1], 5 );
+    return avx512_state && bit( leaf7[1], 16 ) && bit( leaf7[1], 17 ) && bit( leaf7[1], 30 ) && bit( leaf7[1], 31 );
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,74 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include "kernels.h"
+
+#include <string>
+
+/**
+ *  Instruction sets the hot kernels are compiled for, narrowest first.
+ */
+enum class cpu_isa
+{
+    baseline,   // compiler defaults, SSE2 on x86-64
+    avx2,
+    avx512      // F, VL, DQ and BW
+};
+
+/**
+ *  Runtime selection of the kernel variants (kernels.h): at startup, the
+ *  widest one compiled in and supported by the host (CPUID) is used, unless
+ *  the RAYTRACER_ISA environment variable names another one. Every variant
+ *  renders the same images, forcing one only changes the speed.
+ */
+class cpu_dispatch
+{
+public:
+
+    static cpu_dispatch& instance();
+
+    /**
+     *  Kernels of the active variant: a single load, cheap enough for every
+     *  intersection test.
+     */
+    static const kernel_table& kernels() { return *s_kernels; }
+
+    /**
+     *  Widest variant compiled in and supported by the host.
+     */
+    cpu_isa detected() const { return m_detected; }
+
+    cpu_isa active() const { return m_active; }
+
+    /**
+     *  Whether the variant is compiled in and supported by the host.
+     */
+    bool available( cpu_isa isa ) const;
+
+    /**
+     *  Switch to the kernels of isa, returns false when it is not available.
+     *  Not thread safe: to be called before rendering.
+     */
+    bool force( cpu_isa isa );
+
+    static const char* name( cpu_isa isa );
+
+    /**
+     *  isa from its name (baseline, avx2 or avx512), returns false if unknown.
+     */
+    static bool parse( const std::string& name, cpu_isa& isa );
+
+private:
+
+    cpu_dispatch();
+
+    static const kernel_table* table( cpu_isa isa );
+    static bool host_supports( cpu_isa isa );
+
+    cpu_isa m_detected = cpu_isa::baseline;
+    cpu_isa m_active = cpu_isa::baseline;
+
+    static const kernel_table* s_kernels;
+};
+
+#endif
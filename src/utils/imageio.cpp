@@ -6,7 +6,13 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <fstream>
 #include <string>
+#include <vector>
 
 std::unique_ptr<unsigned char[]> imageio::load_image( const std::string& path, int& width, int& height, int& bytes_per_pixel )
 {
@@ -18,3 +24,46 @@ bool imageio::save_image( const std::string& path, int width, int height, int by
 {
     return stbi_write_png(path.c_str(), width, height, bytes_per_pixel, data, 0) != 0;
 }
+
+bool imageio::save_float_image( const std::string& path, int width, int height, const float *data )
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file)
+        return false;
+
+    // negative scale means little endian, scanlines are stored from the bottom
+    const bool little_endian = std::endian::native == std::endian::little;
+    file << "Pf\n" << width << " " << height << "\n" << (little_endian ? "-1.0" : "1.0") << "\n";
+    for(int j = height-1; j >= 0; --j)
+        file.write(reinterpret_cast<const char*>(data + static_cast<std::ptrdiff_t>(j)*width),
+                   static_cast<std::streamsize>(sizeof(float))*width);
+    return static_cast<bool>(file);
+}
+
+bool imageio::save_heatmap( const std::string& path, int width, int height, const float *data )
+{
+    // inferno-like colour ramp, from cold to hot
+    constexpr std::array<std::array<float,3>,5> ramp{{
+        {0.f, 0.f, 4.f}, {87.f, 16.f, 110.f}, {188.f, 55.f, 84.f}, {249.f, 142.f, 9.f}, {252.f, 255.f, 164.f} }};
+
+    const auto count = static_cast<size_t>(width)*static_cast<size_t>(height);
+    if(count == 0)
+        return false;
+
+    // the percentile keeps a few outliers from flattening the rest of the map
+    std::vector<float> sorted(data, data+count);
+    const auto percentile = sorted.begin() + static_cast<std::ptrdiff_t>((count-1)*99/100);
+    std::nth_element(sorted.begin(), percentile, sorted.end());
+    const float hottest = *percentile > 0.f ? *percentile : 1.f;
+
+    std::vector<unsigned char> rgb(3*count);
+    for(size_t k = 0; k < count; ++k)
+    {
+        const float x = std::clamp(data[k]/hottest, 0.f, 1.f) * static_cast<float>(ramp.size()-1);
+        const auto lo = std::min(static_cast<size_t>(x), ramp.size()-2);
+        const float w = x - static_cast<float>(lo);
+        for(size_t c = 0; c < 3; ++c)
+            rgb[3*k+c] = static_cast<unsigned char>(std::lround((1.f-w)*ramp[lo][c] + w*ramp[lo+1][c]));
+    }
+    return save_image(path, width, height, 3, rgb.data());
+}
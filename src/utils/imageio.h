@@ -2,12 +2,17 @@
 #define IMAGEIO_H
 
 #include <memory>
+#include <string>
 
 class imageio
 {
 public:
     static std::unique_ptr<unsigned char[]> load_image( const std::string& path, int& width, int& height, int& bytes_per_pixel );
     static bool save_image( const std::string& path, int width, int height, int bytes_per_pixel, const void *data );
+    // single channel float buffer, row major from the top, saved as a portable float map (.pfm)
+    static bool save_float_image( const std::string& path, int width, int height, const float *data );
+    // single channel float buffer mapped to a false colour png, the 99th percentile being the hottest colour
+    static bool save_heatmap( const std::string& path, int width, int height, const float *data );
 };
 
 #endif
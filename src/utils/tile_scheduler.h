@@ -0,0 +1,274 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+/**
+ *  Image-space rectangle [x0,x1[ x [y0,y1[ processed as a single job.
+ */
+struct tile
+{
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+};
+
+/**
+ *  Work-stealing tile scheduler: each worker owns a deque of tiles, pops
+ *  from its front and, once empty, steals from the back of the others.
+ *  Workers are persistent and a new batch can be submitted once the
+ *  previous one has been waited for.
+ */
+class tile_scheduler
+{
+public:
+
+    using tile_job = std::function<void(const tile&, size_t worker)>;
+
+    /**
+     *  A thread count of zero means std::thread::hardware_concurrency().
+     */
+    explicit tile_scheduler( size_t thread_count = 0 )
+        : m_thread_count( resolve_thread_count( thread_count ) )
+    {
+        for( size_t i = 0; i < m_thread_count; ++i )
+            m_queues.emplace_back( std::make_unique<worker_queue>() );
+        for( size_t i = 0; i < m_thread_count; ++i )
+            m_threads.emplace_back( [this,i]{ this->task( i ); } );
+    }
+
+    ~tile_scheduler()
+    {
+        // scoped lock
+        {
+            std::lock_guard<std::mutex> lock( m_state_mutex );
+            m_bailout = true;
+        }
+        m_batch_var.notify_all();
+
+        for( auto& t : m_threads )
+            if( t.joinable() )
+                t.join();
+    }
+
+    tile_scheduler( const tile_scheduler& ) = delete;
+    tile_scheduler& operator=( const tile_scheduler& ) = delete;
+
+    /**
+     *  Get the number of worker threads.
+     */
+    size_t size() const {
+        return m_thread_count;
+    }
+
+    /**
+     *  Split a width x height image in square tiles, border tiles being cropped.
+     */
+    static std::vector<tile> make_tiles( int width, int height, int tile_size )
+    {
+        std::vector<tile> tiles;
+        for( int y = 0; y < height; y += tile_size )
+            for( int x = 0; x < width; x += tile_size )
+                tiles.push_back( { x, y, std::min( x + tile_size, width ), std::min( y + tile_size, height ) } );
+        return tiles;
+    }
+
+    /**
+     *  Dispatch a batch of tiles to the workers. Contiguous runs of tiles are
+     *  given to each worker so that neighbouring tiles stay on the same core
+     *  until stealing kicks in. Returns immediately.
+     */
+    void submit( const std::vector<tile>& tiles, tile_job job )
+    {
+        const size_t generation = m_generation + 1;
+        const size_t chunk = ( tiles.size() + m_thread_count - 1 ) / m_thread_count;
+        for( size_t w = 0; w < m_thread_count; ++w )
+        {
+            std::lock_guard<std::mutex> lock( m_queues[w]->mutex );
+            const auto first = std::min( w * chunk, tiles.size() );
+            const auto last = std::min( first + chunk, tiles.size() );
+            m_queues[w]->tiles.assign( tiles.begin() + static_cast<std::ptrdiff_t>( first ),
+                                       tiles.begin() + static_cast<std::ptrdiff_t>( last ) );
+            m_queues[w]->generation = generation;
+        }
+
+        // scoped lock
+        {
+            std::lock_guard<std::mutex> lock( m_state_mutex );
+            m_job = std::move( job );
+            m_total = tiles.size();
+            m_done = 0;
+            m_generation = generation;
+        }
+        m_batch_var.notify_all();
+    }
+
+    /**
+     *  Number of tiles of the current batch already processed.
+     */
+    size_t tiles_done() const {
+        return m_done;
+    }
+
+    size_t tiles_total() const {
+        return m_total;
+    }
+
+    /**
+     *  Wait at most `timeout` for the current batch to complete.
+     */
+    template<typename Rep, typename Period>
+    bool wait_for( const std::chrono::duration<Rep,Period>& timeout )
+    {
+        std::unique_lock<std::mutex> lock( m_state_mutex );
+        return m_done_var.wait_for( lock, timeout, [this]{ return m_done == m_total && m_busy == 0; } );
+    }
+
+    /**
+     *  Block until every tile of the current batch has been processed and
+     *  every worker is back to idle, so that a new batch can be submitted.
+     */
+    void wait_all()
+    {
+        std::unique_lock<std::mutex> lock( m_state_mutex );
+        m_done_var.wait( lock, [this]{ return m_done == m_total && m_busy == 0; } );
+    }
+
+private:
+
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<tile> tiles;
+        size_t generation = 0; // batch the queued tiles belong to
+    };
+
+    static std::string trace_args( const tile& t )
+    {
+        return "\"x\":" + std::to_string( t.x0 ) + ",\"y\":" + std::to_string( t.y0 )
+             + ",\"width\":" + std::to_string( t.width() ) + ",\"height\":" + std::to_string( t.height() );
+    }
+
+    static size_t resolve_thread_count( size_t thread_count )
+    {
+        if( thread_count > 0 )
+            return thread_count;
+        return std::max<size_t>( 1, std::thread::hardware_concurrency() );
+    }
+
+    bool pop_local( size_t worker, size_t generation, tile& t )
+    {
+        auto& q = *m_queues[worker];
+        std::lock_guard<std::mutex> lock( q.mutex );
+        if( q.tiles.empty() || q.generation != generation )
+            return false;
+        t = q.tiles.front();
+        q.tiles.pop_front();
+        return true;
+    }
+
+    bool steal( size_t worker, size_t generation, tile& t )
+    {
+        for( size_t k = 1; k < m_thread_count; ++k )
+        {
+            auto& q = *m_queues[( worker + k ) % m_thread_count];
+            std::lock_guard<std::mutex> lock( q.mutex );
+            if( q.tiles.empty() || q.generation != generation )
+                continue;
+            t = q.tiles.back();
+            q.tiles.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     *  Worker loop: wait for a new batch, drain the local deque, then steal
+     *  until every deque is empty. Tiles are tagged with their batch so that
+     *  a late worker never runs a stale job on the tiles of a newer batch.
+     */
+    void task( size_t worker )
+    {
+        if( trace_recorder::instance().enabled() )
+            trace_recorder::instance().set_thread_name( "worker " + std::to_string( worker ) );
+
+        size_t seen_generation = 0;
+        while( true )
+        {
+            tile_job job;
+
+            // scoped lock
+            {
+                std::unique_lock<std::mutex> lock( m_state_mutex );
+                m_batch_var.wait( lock, [&]{ return m_bailout || m_generation != seen_generation; } );
+                if( m_bailout )
+                    return;
+                seen_generation = m_generation;
+                job = m_job;
+                ++m_busy;
+            }
+
+            tile t;
+            while( true )
+            {
+                bool stolen = false;
+                if( !pop_local( worker, seen_generation, t ) )
+                {
+                    if( !steal( worker, seen_generation, t ) )
+                        break;
+                    stolen = true;
+                }
+
+                // scoped trace
+                {
+                    scoped_trace trace( stolen ? "stolen tile" : "tile", "tile",
+                                        trace_recorder::instance().enabled() ? trace_args( t ) : std::string{} );
+                    job( t, worker );
+                }
+                ++m_done;
+            }
+
+            // scoped lock
+            {
+                std::lock_guard<std::mutex> lock( m_state_mutex );
+                --m_busy;
+            }
+            m_done_var.notify_all();
+        }
+    }
+
+private:
+
+    const size_t m_thread_count;
+
+    std::vector<std::unique_ptr<worker_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    tile_job                m_job;
+    std::atomic<size_t>     m_total{ 0 };
+    std::atomic<size_t>     m_done{ 0 };
+    size_t                  m_generation = 0;
+    size_t                  m_busy = 0;
+    bool                    m_bailout = false;
+    std::condition_variable m_batch_var;
+    std::condition_variable m_done_var;
+    std::mutex              m_state_mutex;
+};
+
+#endif //TILE_SCHEDULER_H
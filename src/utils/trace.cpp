@@ -0,0 +1,118 @@
+#include "trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+
+namespace
+{
+    /**
+     *  Write value as the content of a JSON string: quotes, backslashes and
+     *  control characters are escaped.
+     */
+    void write_escaped( std::ostream& os, const std::string_view value )
+    {
+        for( const char c : value )
+        {
+            switch( c )
+            {
+                case '"':  os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n"; break;
+                case '\r': os << "\\r"; break;
+                case '\t': os << "\\t"; break;
+                default:
+                    if( static_cast<unsigned char>( c ) < 0x20 )
+                        os << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << static_cast<int>( c )
+                           << std::dec << std::setfill( ' ' );
+                    else
+                        os << c;
+            }
+        }
+    }
+}
+
+trace_recorder& trace_recorder::instance()
+{
+    static trace_recorder recorder;
+    return recorder;
+}
+
+void trace_recorder::enable()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_origin = clock::now();
+    m_enabled.store( true, std::memory_order_relaxed );
+}
+
+std::uint32_t trace_recorder::thread_id()
+{
+    static std::atomic<std::uint32_t> next_id{ 0 };
+    thread_local const std::uint32_t id = next_id++;
+    return id;
+}
+
+void trace_recorder::set_thread_name( const std::string& name )
+{
+    if( !enabled() )
+        return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    const auto id = thread_id();
+    for( auto& [thread, thread_name] : m_thread_names )
+    {
+        if( thread == id )
+        {
+            thread_name = name;
+            return;
+        }
+    }
+    m_thread_names.emplace_back( id, name );
+}
+
+void trace_recorder::add_event( const char* name, const char* category, clock::time_point start, clock::time_point end,
+                                std::string args )
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_events.push_back( { name, category,
+                          duration_cast<microseconds>( start - m_origin ).count(),
+                          duration_cast<microseconds>( end - start ).count(),
+                          thread_id(), std::move( args ) } );
+}
+
+bool trace_recorder::write( const std::string& path ) const
+{
+    std::ofstream file( path );
+    if( !file )
+        return false;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for( const auto& [thread, name] : m_thread_names )
+    {
+        file << ( first ? "" : ",\n" )
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+             << ",\"args\":{\"name\":\"";
+        write_escaped( file, name );
+        file << "\"}}";
+        first = false;
+    }
+    for( const auto& e : m_events )
+    {
+        file << ( first ? "" : ",\n" ) << "{\"name\":\"";
+        write_escaped( file, e.name );
+        file << "\",\"cat\":\"";
+        write_escaped( file, e.category );
+        file << "\",\"ph\":\"X\",\"pid\":1"
+             << ",\"tid\":" << e.thread << ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+             << ",\"args\":{" << e.args << "}}";
+        first = false;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>( file );
+}
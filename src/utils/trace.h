@@ -0,0 +1,104 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ *  Timeline recorder writing Chrome trace-event JSON (chrome://tracing,
+ *  ui.perfetto.dev). Recording is off until enable() is called: scoped
+ *  timers then only cost a relaxed atomic load.
+ */
+class trace_recorder
+{
+public:
+
+    using clock = std::chrono::steady_clock;
+
+    static trace_recorder& instance();
+
+    /**
+     *  Start recording, event timestamps being relative to this call.
+     */
+    void enable();
+
+    bool enabled() const { return m_enabled.load( std::memory_order_relaxed ); }
+
+    /**
+     *  Name the calling thread in the timeline, replacing its previous name.
+     *  Ignored while recording is off.
+     */
+    void set_thread_name( const std::string& name );
+
+    /**
+     *  Record a complete event of the calling thread. args is either empty
+     *  or the members of a JSON object, e.g. "\"x\":1,\"y\":2".
+     */
+    void add_event( const char* name, const char* category, clock::time_point start, clock::time_point end,
+                    std::string args = {} );
+
+    /**
+     *  Write the events recorded so far, returns false on I/O failure.
+     */
+    bool write( const std::string& path ) const;
+
+private:
+
+    struct event
+    {
+        const char*     name;
+        const char*     category;
+        std::int64_t    start_us;
+        std::int64_t    duration_us;
+        std::uint32_t   thread;
+        std::string     args;
+    };
+
+    static std::uint32_t thread_id();
+
+    std::atomic<bool>   m_enabled{ false };
+    clock::time_point   m_origin;
+
+    mutable std::mutex  m_mutex;
+    std::vector<event>  m_events;
+    std::vector<std::pair<std::uint32_t,std::string>> m_thread_names;
+};
+
+/**
+ *  Record the lifetime of the object as an event of the calling thread.
+ *  name and category must outlive the recorder (string literals).
+ */
+class scoped_trace
+{
+public:
+
+    explicit scoped_trace( const char* name, const char* category = "render", std::string args = {} )
+        : m_name( name ), m_category( category ), m_args( std::move( args ) )
+    {
+        if( trace_recorder::instance().enabled() )
+            m_start = trace_recorder::clock::now();
+    }
+
+    ~scoped_trace()
+    {
+        if( m_start != trace_recorder::clock::time_point{} )
+            trace_recorder::instance().add_event( m_name, m_category, m_start, trace_recorder::clock::now(), std::move( m_args ) );
+    }
+
+    scoped_trace( const scoped_trace& ) = delete;
+    scoped_trace& operator=( const scoped_trace& ) = delete;
+
+private:
+
+    const char*                     m_name;
+    const char*                     m_category;
+    std::string                     m_args;
+    trace_recorder::clock::time_point m_start{};
+};
+
+#endif
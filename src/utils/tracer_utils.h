@@ -1,19 +1,25 @@
 #ifndef TRACER_UTILS_H
 #define TRACER_UTILS_H
 
+#include "real.h"
+#include "rng.h"
+#include "sampler.h"
+
+#include <array>
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+#include <type_traits>
 
 // Constants
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi = 3.1415926535897932385;
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi = static_cast<real>(3.1415926535897932385);
 
 // Utility Functions
 
-inline double degrees_to_radians(double degrees) {
-    return degrees * pi / 180.0;
+template<typename T>
+inline T degrees_to_radians(T degrees) {
+    return degrees * static_cast<T>(3.1415926535897932385) / 180;
 }
 
 inline double clamp(double x, double min, double max) {
@@ -24,20 +30,65 @@ inline double clamp(double x, double min, double max) {
 
 // Random functions
 
-inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+// Each thread draws from its own generator: the engine reseeds it for every
+// pixel sample, so renders do not depend on thread count nor scheduling.
+inline pcg32& thread_rng() {
+    thread_local pcg32 generator;
+    return generator;
+}
+
+inline real random_real() {
+    // Returns a random real in [0,1).
+    if constexpr (std::is_same_v<real,float>)
+        return thread_rng().next_float();
+    else
+        return thread_rng().next_double();
 }
 
-inline double random_double(double min, double max) {
+inline real random_real(real min, real max) {
     // Returns a random real in [min,max).
-    return min + (max-min)*random_double();
+    return min + (max-min)*random_real();
 }
 
 inline int random_int(int min, int max) {
     // Returns a random integer in [min,max].
-    return static_cast<int>(random_double(min, max+1));
+    return static_cast<int>(random_real(static_cast<real>(min), static_cast<real>(max+1)));
+}
+
+// Sample functions
+
+// Pixel sample computed by the thread, started by the engine: the camera and
+// the materials draw its dimensions from the sampler of the render.
+inline sample_stream& thread_sample_stream() {
+    thread_local sample_stream stream;
+    return stream;
+}
+
+// Ends the pixel samples the thread starts within its scope: the stream of
+// the thread no longer refers to the sampler, which the engine may destroy.
+struct sample_stream_scope {
+    sample_stream_scope() = default;
+    sample_stream_scope(const sample_stream_scope&) = delete;
+    sample_stream_scope& operator=(const sample_stream_scope&) = delete;
+    ~sample_stream_scope() { thread_sample_stream().source = nullptr; }
+};
+
+inline real next_sample_1d() {
+    // outside of a render, as the independent sampler
+    auto& stream = thread_sample_stream();
+    if (!stream.source)
+        return random_real();
+    return stream.source->get_1d(stream, stream.dimension++);
+}
+
+inline std::array<real,2> next_sample_2d() {
+    auto& stream = thread_sample_stream();
+    if (!stream.source) {
+        const auto u1 = random_real();
+        const auto u2 = random_real();
+        return {u1, u2};
+    }
+    return stream.source->get_2d(stream, stream.dimension++);
 }
 
 // Common Headers